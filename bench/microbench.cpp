@@ -0,0 +1,298 @@
+/*
+ * Buchess, a UCI chess engine derived from Stockfish 9
+ * Copyright (C) 2018-2019 Andrei Guga
+ *
+ * Buchess is free, and distributed under the
+ * GNU General Public License Version 3 (GPLv3).
+ */
+
+/// buchess_bench times the hot paths of the engine over the benchmark
+/// positions and prints the results as JSON, so that runs can be compared
+/// across commits:
+///
+///   buchess_bench [--reps N] [--warmup N] [--filter TEXT]
+///
+/// Each benchmark is calibrated to run at least MinSampleTime per sample, then
+/// runs 'warmup' untimed samples and 'reps' timed ones. The time per operation
+/// of the samples is reported as min, 10th percentile, median, 90th percentile
+/// and max.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "benchmark.h"
+#include "bitboard.h"
+#include "board.h"
+#include "git_sha.h" // Generated at build time
+#include "misc.h"
+#include "movegen.h"
+#include "position.h"
+#include "uci.h"
+
+using namespace std;
+
+namespace {
+
+    constexpr double MinSampleTime = 0.01; // Seconds
+
+    // Results are xor-ed in here, so that the compiler cannot drop the work
+    volatile uint64_t Sink;
+
+    struct Sample {
+        Position pos;
+        StateInfo st;
+        vector<Move> moves;       // Legal moves
+        vector<string> uciMoves;  // The same in coordinate notation
+    };
+
+    typedef vector<unique_ptr<Sample>> Corpus;
+
+    struct Result {
+        string name;
+        uint64_t opsPerSample;
+        vector<double> nsPerOp; // Sorted
+    };
+
+
+    // percentile() returns the given percentile of sorted values, interpolating
+    // between the two nearest ranks.
+
+    double percentile(const vector<double>& v, double p)
+    {
+        const double rank = p / 100 * (v.size() - 1);
+        const size_t lo = size_t(rank);
+        const size_t hi = min(lo + 1, v.size() - 1);
+        return v[lo] + (v[hi] - v[lo]) * (rank - lo);
+    }
+
+
+    // measure() times a workload, a function running some operations over the
+    // corpus and returning their number. The workload is repeated within a
+    // sample as many times as needed to last at least MinSampleTime.
+
+    template<typename Workload>
+    Result measure(const string& name, int warmup, int reps, Workload workload)
+    {
+        auto seconds = [](chrono::steady_clock::time_point start) {
+            return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        };
+
+        // Calibrate the number of workload runs per sample, once warmed up
+        workload();
+        auto start = chrono::steady_clock::now();
+        uint64_t ops = workload();
+        const double once = max(seconds(start), 1e-9);
+        const int runs = max(1, int(MinSampleTime / once + 1));
+
+        auto sample = [&]() {
+            uint64_t n = 0;
+            for (int i = 0; i < runs; ++i)
+                n += workload();
+            return n;
+        };
+
+        for (int i = 0; i < warmup; ++i)
+            sample();
+
+        Result r = { name, ops * runs, {} };
+
+        for (int i = 0; i < reps; ++i) {
+            start = chrono::steady_clock::now();
+            ops = sample();
+            r.nsPerOp.push_back(seconds(start) * 1e9 / max(ops, uint64_t(1)));
+        }
+
+        sort(r.nsPerOp.begin(), r.nsPerOp.end());
+        return r;
+    }
+
+
+    // The workloads
+
+    // Bitboards::init() is all the table setup left at startup: it fills the
+    // slider attack tables, the other tables are compile-time constants.
+    uint64_t bitboards_init()
+    {
+        Bitboards::init();
+        Sink = Sink ^ attacks_bb<ROOK>(SQ_A1, 0);
+        return 1;
+    }
+
+    uint64_t attacks(const Corpus& corpus, PieceType pt)
+    {
+        uint64_t ops = 0, acc = 0;
+
+        for (const auto& s : corpus)
+            for (Bitboard b = s->pos.pieces(pt); b; ++ops)
+                acc ^= figure_attacks_from(pt, s->pos, pop_lsb(&b));
+
+        Sink = Sink ^ acc;
+        return ops;
+    }
+
+    template<GenType T>
+    uint64_t generation(const Corpus& corpus)
+    {
+        ExtMove moveList[MAX_MOVES];
+        uint64_t ops = 0, acc = 0;
+
+        for (const auto& s : corpus) {
+            // EVASIONS needs a position in check, the other pseudo-legal
+            // generators a position not in check.
+            if (T != LEGAL && bool(s->pos.checkers()) != (T == EVASIONS))
+                continue;
+
+            acc += generate<T>(s->pos, moveList) - moveList;
+            ++ops;
+        }
+
+        Sink = Sink ^ acc;
+        return ops;
+    }
+
+    uint64_t do_undo(Corpus& corpus)
+    {
+        StateInfo st;
+        uint64_t ops = 0;
+
+        for (auto& s : corpus)
+            for (Move m : s->moves) {
+                s->pos.do_move(m, st);
+                s->pos.undo_move(m);
+                ++ops;
+            }
+
+        return ops;
+    }
+
+    uint64_t set_fen(const vector<string>& fens)
+    {
+        StateInfo st;
+        Position pos;
+        uint64_t acc = 0;
+
+        for (const string& fen : fens)
+            acc ^= pos.set(fen, &st).key();
+
+        Sink = Sink ^ acc;
+        return fens.size();
+    }
+
+    uint64_t to_move(Corpus& corpus)
+    {
+        uint64_t ops = 0, acc = 0;
+
+        for (auto& s : corpus)
+            for (string& str : s->uciMoves) {
+                acc += UCI::to_move(s->pos, str);
+                ++ops;
+            }
+
+        Sink = Sink ^ acc;
+        return ops;
+    }
+
+
+    void print_json(ostream& os, const vector<Result>& results, size_t corpusSize, int warmup, int reps)
+    {
+        os << "{\n"
+           << "  \"engine\": \"" << engine_info() << "\",\n"
+           << "  \"commit\": \"" << BUCHESS_GIT_SHA << "\",\n"
+           << "  \"corpus_size\": " << corpusSize << ",\n"
+           << "  \"warmup\": " << warmup << ",\n"
+           << "  \"repetitions\": " << reps << ",\n"
+           << "  \"benchmarks\": [";
+
+        os << fixed << setprecision(3);
+
+        for (size_t i = 0; i < results.size(); ++i) {
+            const Result& r = results[i];
+            const vector<double>& v = r.nsPerOp;
+
+            os << (i ? "," : "") << "\n    {"
+               << "\"name\": \"" << r.name << "\", "
+               << "\"ops_per_sample\": " << r.opsPerSample << ", "
+               << "\"ns_per_op\": {"
+               << "\"min\": " << v.front() << ", "
+               << "\"p10\": " << percentile(v, 10) << ", "
+               << "\"median\": " << percentile(v, 50) << ", "
+               << "\"p90\": " << percentile(v, 90) << ", "
+               << "\"max\": " << v.back() << "}}";
+        }
+
+        os << "\n  ]\n}" << endl;
+    }
+
+} // namespace
+
+
+int main(int argc, char* argv[])
+{
+    int warmup = 3, reps = 25;
+    string filter;
+
+    for (int i = 1; i < argc; i += 2) {
+        const string option = argv[i];
+        const bool hasValue = i + 1 < argc;
+
+        if (hasValue && option == "--reps")
+            reps = max(1, atoi(argv[i + 1]));
+        else if (hasValue && option == "--warmup")
+            warmup = max(0, atoi(argv[i + 1]));
+        else if (hasValue && option == "--filter")
+            filter = argv[i + 1];
+        else {
+            cerr << "Usage: buchess_bench [--reps N] [--warmup N] [--filter TEXT]" << endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    Bitboards::init();
+
+    Corpus corpus;
+
+    for (const string& fen : Benchmark::Fens) {
+        corpus.emplace_back(new Sample);
+        Sample& s = *corpus.back();
+        s.pos.set(fen, &s.st);
+
+        for (const auto& m : MoveList<LEGAL>(s.pos)) {
+            s.moves.push_back(m);
+            s.uciMoves.push_back(UCI::move(m));
+        }
+    }
+
+    vector<Result> results;
+
+    auto run = [&](const string& name, auto workload) {
+        if (name.find(filter) != string::npos)
+            results.push_back(measure(name, warmup, reps, workload));
+    };
+
+    run("Bitboards::init",       [&]() { return bitboards_init(); });
+
+    const char* PieceTypeNames[] = { "", "PAWN", "KNIGHT", "BISHOP", "ROOK", "QUEEN", "KING" };
+
+    for (PieceType pt : { PAWN, KNIGHT, BISHOP, ROOK, QUEEN, KING })
+        run(string("figure_attacks_from/") + PieceTypeNames[pt], [&, pt]() { return attacks(corpus, pt); });
+
+    run("generate/CAPTURES",     [&]() { return generation<CAPTURES    >(corpus); });
+    run("generate/QUIETS",       [&]() { return generation<QUIETS      >(corpus); });
+    run("generate/QUIET_CHECKS", [&]() { return generation<QUIET_CHECKS>(corpus); });
+    run("generate/NON_EVASIONS", [&]() { return generation<NON_EVASIONS>(corpus); });
+    run("generate/EVASIONS",     [&]() { return generation<EVASIONS    >(corpus); });
+    run("generate/LEGAL",        [&]() { return generation<LEGAL       >(corpus); });
+    run("Position::do_move+undo_move", [&]() { return do_undo(corpus); });
+    run("Position::set",         [&]() { return set_fen(Benchmark::Fens); });
+    run("UCI::to_move",          [&]() { return to_move(corpus); });
+
+    print_json(cout, results, corpus.size(), warmup, reps);
+
+    return EXIT_SUCCESS;
+}
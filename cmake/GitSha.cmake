@@ -0,0 +1,26 @@
+# Writes OUTPUT, a header defining BUCHESS_GIT_SHA as the short hash of the
+# commit checked out in SOURCE_DIR. Run at every build, so that the hash follows
+# new commits, and the header is rewritten only when the hash has changed.
+
+set(GIT_SHA "unknown")
+
+if(GIT_EXECUTABLE)
+    execute_process(COMMAND ${GIT_EXECUTABLE} rev-parse --short HEAD
+                    WORKING_DIRECTORY ${SOURCE_DIR}
+                    OUTPUT_VARIABLE SHA
+                    OUTPUT_STRIP_TRAILING_WHITESPACE
+                    ERROR_QUIET)
+    if(SHA)
+        set(GIT_SHA ${SHA})
+    endif()
+endif()
+
+set(CONTENT "#define BUCHESS_GIT_SHA \"${GIT_SHA}\"\n")
+
+if(EXISTS ${OUTPUT})
+    file(READ ${OUTPUT} OLD_CONTENT)
+endif()
+
+if(NOT CONTENT STREQUAL OLD_CONTENT)
+    file(WRITE ${OUTPUT} ${CONTENT})
+endif()
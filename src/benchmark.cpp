@@ -0,0 +1,359 @@
+#include <cassert>
+#include <chrono>
+#include <iomanip>
+#include <ostream>
+
+#include "benchmark.h"
+#include "movegen.h"
+#include "perft.h"
+#include "position.h"
+
+using namespace std;
+
+
+/// Positions used by the benchmarks. A few of them are in check, so that the
+/// evasion generator is measured too.
+
+const vector<string> Benchmark::Fens = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 10",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 11",
+    "4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - - 7 19",
+    "rq3rk1/ppp2ppp/1bnpb3/3N2B1/3NP3/7P/PPPQ1PP1/2KR3R w - - 7 14",
+    "r1bq1r1k/1pp1n1pp/1p1p4/4p2Q/4Pp2/1BNP4/PPP2PPP/3R1RK1 w - - 2 14",
+    "r3r1k1/2p2ppp/p1p1bn2/8/1q2P3/2NPQN2/PPP3PP/R4RK1 b - - 2 15",
+    "r1bbk1nr/pp3p1p/2n5/1N4p1/2Np1B2/8/PPP2PPP/2KR1B1R w kq - 0 13",
+    "r1bq1rk1/ppp1nppp/4n3/3p3Q/3P4/1BP1B3/PP1N2PP/R4RK1 w - - 1 16",
+    "4r1k1/r1q2ppp/ppp2n2/4P3/5Rb1/1N1BQ3/PPP3PP/R5K1 w - - 1 17",
+    "2rqkb1r/ppp2p2/2npb1p1/1N1Nn2p/2P1PP2/8/PP2B1PP/R1BQK2R b KQ - 0 11",
+    "r1bq1rk1/pp3ppp/2n1pn2/3p4/1bPP4/2NB1N2/PPQ2PPP/R1B1K2R w KQ - 3 9",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+    "8/8/8/8/5kp1/P7/8/1K1N4 w - - 0 1",
+    "r1bq1r1k/b1p1npp1/p2p3p/1p6/3PP3/1B2NN2/PP3PPP/R2Q1RK1 w - - 1 16",
+    "3r1rk1/p5pp/bpp1pp2/8/q1PP1P2/b3P3/P2NQRPP/1R2B1K1 b - - 6 22",
+    "r1q2rk1/2p1bppp/2Pp4/p6b/Q1PNp3/4B3/PP1R1PPP/2K4R w - - 2 18",
+    "4k2r/1pb2ppp/1p2p3/1R1p4/3P4/2r1PN2/P4PPP/1R4K1 b - - 3 22",
+    "3q2k1/pb3p1p/4pbp1/2r5/PpN2N2/1P2P2P/5PP1/Q2R2K1 b - - 4 26",
+    "6k1/6p1/6Pp/ppp5/3pn2P/1P3K2/1PP2P2/8 b - - 0 1",
+    "8/8/8/5N2/8/p7/8/2NK3k w - - 0 1",
+    "8/3k4/8/8/8/4B3/4KB2/2B5 w - - 0 1",
+    "8/8/1P6/5pr1/8/4R3/7k/2K5 w - - 0 1",
+    "8/2p4P/8/kr6/6R1/8/8/1K6 w - - 0 1",
+    "8/8/3P3k/8/1p6/8/1P6/1K3n2 b - - 0 1",
+    "8/R7/2q5/8/6k1/8/1P5p/K6R w - - 0 124",
+    "6k1/3b3r/1p1p4/p1n2p2/1PPNpP1q/P3Q1p1/1R1RB1P1/5K2 b - - 0 1",
+    "r2r1n2/pp2bk2/2p1p2p/3q4/3PN1QP/2P3R1/P4PP1/5RK1 w - - 0 1",
+    "8/8/8/8/8/6k1/6p1/6K1 w - - 0 1",
+    "rnbqkb1r/pp1p1ppp/2p5/4P3/2B5/8/PPP1NnPP/RNBQK2R w KQkq - 0 6",
+    "n1n5/PPPk4/8/8/8/8/4Kppp/5N1N b - - 0 1",
+    
+    // Positions without legal moves
+    "7k/7P/6K1/8/3B4/8/8/8 b - - 0 1",
+    "3R2k1/5ppp/8/8/8/8/5PPP/6K1 b - - 0 1",
+    
+    // Positions in check
+    "rnbqkbnr/ppp2ppp/8/1B1pp3/4P3/8/PPPP1PPP/RNBQK1NR b KQkq - 1 3",
+    "rnbqk1nr/pppp1ppp/8/4p3/1b1P4/5N2/PPP1PPPP/RNBQKB1R w KQkq - 2 3",
+    "4k3/8/8/8/1b6/8/8/R3K2R w KQ - 0 1",
+    "8/8/8/2k5/3Pp3/8/8/4K3 b - d3 0 1",
+};
+
+
+/// The standard perft reference positions, from the start position to the
+/// "kiwipete" and the promotion, castling and en passant test positions.
+
+const vector<Benchmark::PerftPosition> Benchmark::PerftPositions = {
+    { "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+      { 20, 400, 8902, 197281, 4865609, 119060324 } },
+    { "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+      { 48, 2039, 97862, 4085603, 193690690, 8031647685 } },
+    { "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+      { 14, 191, 2812, 43238, 674624, 11030083 } },
+    { "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+      { 6, 264, 9467, 422333, 15833292, 706045033 } },
+    { "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+      { 44, 1486, 62379, 2103487, 89941194, 3048196529 } },
+    { "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+      { 46, 2079, 89890, 3894594, 164075551, 6923051137 } },
+};
+
+
+namespace {
+    
+    template<GenType T>
+    void bench_type(ostream& os, const char* name, bool inCheck, int iterations)
+    {
+        ExtMove moveList[MAX_MOVES];
+        uint64_t calls = 0, moves = 0;
+        
+        auto start = chrono::steady_clock::now();
+        
+        for (const string& fen : Benchmark::Fens) {
+            StateInfo st;
+            Position pos;
+            pos.set(fen, &st);
+            
+            if (bool(pos.checkers()) != inCheck)
+                continue;
+            
+            for (int i = 0; i < iterations; ++i)
+                moves += generate<T>(pos, moveList) - moveList;
+            
+            calls += iterations;
+        }
+        
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        
+        os << setw(13) << left << name
+           << setw(10) << right << calls << " calls "
+           << setw(11) << moves << " moves "
+           << setw(9) << fixed << setprecision(2) << moves / elapsed / 1e6 << " Mmoves/s "
+           << setw(9) << calls / elapsed / 1e6 << " Mcalls/s" << endl;
+    }
+    
+    
+    // perft_suite() runs perft on the reference positions, printing a line per
+    // position if a stream is given, and returns the elapsed time in seconds.
+    // 'ok' is cleared if a leaf count is wrong.
+    
+    double perft_suite(ostream* os, int depth, int threads, uint64_t& total, bool& ok)
+    {
+        double totalElapsed = 0;
+        total = 0;
+        
+        for (const Benchmark::PerftPosition& pp : Benchmark::PerftPositions) {
+            StateInfo st;
+            Position pos;
+            pos.set(pp.fen, &st);
+            
+            auto start = chrono::steady_clock::now();
+            uint64_t nodes = Perft::perft(pos, depth, threads);
+            double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            
+            const bool match = nodes == pp.nodes[depth - 1];
+            ok &= match;
+            total += nodes;
+            totalElapsed += elapsed;
+            
+            if (os)
+                *os << (match ? "ok   " : "FAIL ")
+                    << setw(12) << nodes << " nodes "
+                    << setw(9) << fixed << setprecision(2) << nodes / max(elapsed, 1e-9) / 1e6 << " Mnps  "
+                    << pp.fen << endl;
+        }
+        
+        return totalElapsed;
+    }
+    
+} // namespace
+
+
+/// Benchmark::run() is the default bench: perft to a fixed depth on all the
+/// benchmark positions. The total node count is a signature of the move
+/// generator, it must not change with a non-functional patch and it does not
+/// depend on the number of threads or on the hash size.
+
+void Benchmark::run(ostream& os, int depth, int threads, size_t hashMB)
+{
+    const size_t oldHashMB = Perft::TT.size_mb();
+    uint64_t nodes = 0;
+    
+    Perft::TT.resize(hashMB); // Start from an empty table to be reproducible
+    
+    auto start = chrono::steady_clock::now();
+    
+    for (size_t i = 0; i < Fens.size(); ++i) {
+        StateInfo st;
+        Position pos;
+        pos.set(Fens[i], &st);
+        
+        uint64_t cnt = Perft::perft(pos, depth, threads);
+        nodes += cnt;
+        
+        os << "Position " << setw(2) << i + 1 << '/' << Fens.size() << ": " << cnt << endl;
+    }
+    
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    
+    os << "\n==========================="
+       << "\nTotal time (ms) : " << uint64_t(elapsed * 1000)
+       << "\nNodes searched  : " << nodes
+       << "\nNodes/second    : " << uint64_t(nodes / max(elapsed, 1e-9)) << endl;
+    
+    Perft::TT.resize(oldHashMB);
+}
+
+
+/// Benchmark::movegen() times each move generator type over the benchmark
+/// positions and reports its throughput. EVASIONS is measured on the positions
+/// in check, the other pseudo-legal generators on the positions not in check.
+
+void Benchmark::movegen(ostream& os, int iterations)
+{
+    bench_type<CAPTURES    >(os, "CAPTURES",     false, iterations);
+    bench_type<QUIETS      >(os, "QUIETS",       false, iterations);
+    bench_type<QUIET_CHECKS>(os, "QUIET_CHECKS", false, iterations);
+    bench_type<NON_EVASIONS>(os, "NON_EVASIONS", false, iterations);
+    bench_type<EVASIONS    >(os, "EVASIONS",     true,  iterations);
+    bench_type<LEGAL       >(os, "LEGAL",        false, iterations);
+    bench_type<LEGAL       >(os, "LEGAL",        true,  iterations);
+}
+
+
+/// Benchmark::see() times see_ge() on every capture of the benchmark positions
+/// not in check, with a zero threshold as used to prune losing captures.
+
+void Benchmark::see(ostream& os, int iterations)
+{
+    uint64_t calls = 0, good = 0;
+    
+    auto start = chrono::steady_clock::now();
+    
+    for (const string& fen : Fens) {
+        StateInfo st;
+        Position pos;
+        pos.set(fen, &st);
+        
+        if (pos.checkers())
+            continue;
+        
+        const MoveList<CAPTURES> captures(pos);
+        
+        for (int i = 0; i < iterations; ++i)
+            for (const auto& m : captures)
+                good += pos.see_ge(m);
+        
+        calls += uint64_t(iterations) * captures.size();
+    }
+    
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    
+    os << setw(13) << left << "SEE"
+       << setw(10) << right << calls << " calls "
+       << setw(11) << good << " good  "
+       << setw(9) << fixed << setprecision(2) << calls / elapsed / 1e6 << " Mcalls/s" << endl;
+}
+
+
+/// Benchmark::perft() runs perft at the given depth on the reference positions,
+/// checks the leaf counts against the known ones and reports the speed. It
+/// returns false if any count is wrong. With a hash size the suite is run
+/// first without and then with the perft table, and the hit rate and the
+/// speedup are reported.
+
+bool Benchmark::perft(ostream& os, int depth, int threads, size_t hashMB)
+{
+    assert(depth >= 1 && depth <= MaxPerftDepth);
+    
+    const size_t oldHashMB = Perft::TT.size_mb();
+    uint64_t total;
+    bool ok = true;
+    double baseline = 0;
+    
+    if (hashMB) {
+        Perft::TT.resize(0);
+        baseline = perft_suite(nullptr, depth, threads, total, ok);
+        Perft::TT.resize(hashMB);
+    }
+    
+    double elapsed = perft_suite(&os, depth, threads, total, ok);
+    
+    os << "\nTotal " << total << " nodes, depth " << depth << ", " << threads << " threads, "
+       << fixed << setprecision(3) << elapsed << " s, "
+       << setprecision(2) << total / max(elapsed, 1e-9) / 1e6 << " Mnps" << endl;
+    
+    if (hashMB) {
+        os << "Hash " << hashMB << " MB, " << Perft::TT.hits << " hits / " << Perft::TT.probes << " probes ("
+           << 100.0 * Perft::TT.hits / max(uint64_t(Perft::TT.probes), uint64_t(1)) << "%), "
+           << baseline / max(elapsed, 1e-9) << "x speedup over "
+           << setprecision(3) << baseline << " s without hash" << endl;
+        
+        Perft::TT.resize(oldHashMB);
+    }
+    
+    return ok;
+}
+
+
+/// Benchmark::scaling() runs perft at the given depth on the reference positions
+/// with 1, 2, 4, ... threads up to maxThreads and reports the speed and the
+/// speedup over a single thread.
+
+void Benchmark::scaling(ostream& os, int depth, int maxThreads)
+{
+    double base = 0;
+    
+    for (int threads = 1; ; threads = min(2 * threads, maxThreads)) {
+        uint64_t total = 0;
+        
+        auto start = chrono::steady_clock::now();
+        
+        for (const PerftPosition& pp : PerftPositions) {
+            StateInfo st;
+            Position pos;
+            pos.set(pp.fen, &st);
+            total += Perft::perft(pos, depth, threads);
+        }
+        
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        double nps = total / max(elapsed, 1e-9);
+        
+        if (threads == 1)
+            base = nps;
+        
+        os << setw(4) << threads << " threads "
+           << setw(12) << total << " nodes "
+           << setw(9) << fixed << setprecision(2) << nps / 1e6 << " Mnps "
+           << setw(6) << nps / base << "x" << endl;
+        
+        if (threads >= maxThreads)
+            break;
+    }
+}
+
+
+/// Benchmark::walker() compares the plain recursive perft with the interleaved
+/// coroutine walker on the reference positions, on one thread, with no perft
+/// table and with 1, 16 and 256 MB tables, from about cache-sized up to much
+/// larger than the cache.
+
+void Benchmark::walker(ostream& os, int depth, int walkers)
+{
+#ifndef USE_COROUTINES
+    os << "Coroutines are not supported by this build, the walker is the plain one" << endl;
+#endif
+    
+    const size_t oldHashMB = Perft::TT.size_mb();
+    
+    for (size_t hashMB : { 0, 1, 16, 256 }) {
+        uint64_t plainNodes = 0, walkerNodes = 0;
+        double plain = 0, interleaved = 0;
+        
+        for (const PerftPosition& pp : PerftPositions) {
+            StateInfo st;
+            Position pos;
+            pos.set(pp.fen, &st);
+            
+            Perft::TT.resize(hashMB);
+            auto start = chrono::steady_clock::now();
+            plainNodes += Perft::perft(pos, depth);
+            plain += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            
+            Perft::TT.resize(hashMB);
+            start = chrono::steady_clock::now();
+            walkerNodes += Perft::interleaved_perft(pos, depth, walkers);
+            interleaved += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        }
+        
+        os << setw(5) << hashMB << " MB hash: plain "
+           << setw(8) << fixed << setprecision(2) << plainNodes / max(plain, 1e-9) / 1e6 << " Mnps, "
+           << walkers << " walkers "
+           << setw(8) << walkerNodes / max(interleaved, 1e-9) / 1e6 << " Mnps, "
+           << setw(5) << plain / max(interleaved, 1e-9) << "x"
+           << (plainNodes == walkerNodes ? "" : "  node counts differ!") << endl;
+    }
+    
+    Perft::TT.resize(oldHashMB);
+}
@@ -0,0 +1,32 @@
+#ifndef BENCHMARK_H_INCLUDED
+#define BENCHMARK_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace Benchmark {
+    
+    extern const std::vector<std::string> Fens;
+    
+    /// A perft reference position with the known leaf counts for depth 1 to 6
+    struct PerftPosition {
+        const char* fen;
+        uint64_t nodes[6];
+    };
+    
+    extern const std::vector<PerftPosition> PerftPositions;
+    constexpr int MaxPerftDepth = 6;
+    
+    void run(std::ostream& os, int depth, int threads, size_t hashMB);
+    void movegen(std::ostream& os, int iterations);
+    void see(std::ostream& os, int iterations);
+    bool perft(std::ostream& os, int depth, int threads = 1, size_t hashMB = 0);
+    void scaling(std::ostream& os, int depth, int maxThreads);
+    void walker(std::ostream& os, int depth, int walkers);
+    
+} // namespace Benchmark
+
+#endif // #ifndef BENCHMARK_H_INCLUDED
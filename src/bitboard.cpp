@@ -1,22 +1,258 @@
 #include "bitboard.h"
 
-Bitboard SquareBB[SQUARE_NB];
-Bitboard FileBB[FILE_NB];
-Bitboard RankBB[RANK_NB];
+namespace {
+    
+    Bitboard RookTable[0x19000];  // To store rook attacks
+    Bitboard BishopTable[0x1480]; // To store bishop attacks
+    
+    // Magic numbers for the "fancy" magic bitboards. They were found with the
+    // usual trial and error search over sparse random numbers and are embedded
+    // here so that nothing has to be searched at startup.
+    constexpr Bitboard RookMagicNumbers[SQUARE_NB] = {
+        0x0A80004000801220ULL, 0x8040004010002008ULL, 0x2080200010008008ULL, 0x1100100008210004ULL,
+        0xC200209084020008ULL, 0x2100010004000208ULL, 0x0400081000822421ULL, 0x0200010422048844ULL,
+        0x0800800080400024ULL, 0x0001402000401000ULL, 0x3000801000802001ULL, 0x4400800800100083ULL,
+        0x0904802402480080ULL, 0x4040800400020080ULL, 0x0018808042000100ULL, 0x4040800080004100ULL,
+        0x0040048001458024ULL, 0x00A0004000205000ULL, 0x3100808010002000ULL, 0x4825010010000820ULL,
+        0x5004808008000401ULL, 0x2024818004000A00ULL, 0x0005808002000100ULL, 0x2100060004806104ULL,
+        0x0080400880008421ULL, 0x4062220600410280ULL, 0x010A004A00108022ULL, 0x0000100080080080ULL,
+        0x0021000500080010ULL, 0x0044000202001008ULL, 0x0000100400080102ULL, 0xC020128200040545ULL,
+        0x0080002000400040ULL, 0x0000804000802004ULL, 0x0000120022004080ULL, 0x010A386103001001ULL,
+        0x9010080080800400ULL, 0x8440020080800400ULL, 0x0004228824001001ULL, 0x000000490A000084ULL,
+        0x0080002000504000ULL, 0x200020005000C000ULL, 0x0012088020420010ULL, 0x0010010080080800ULL,
+        0x0085001008010004ULL, 0x0002000204008080ULL, 0x0040413002040008ULL, 0x0000304081020004ULL,
+        0x0080204000800080ULL, 0x3008804000290100ULL, 0x1010100080200080ULL, 0x2008100208028080ULL,
+        0x5000850800910100ULL, 0x8402019004680200ULL, 0x0120911028020400ULL, 0x0000008044010200ULL,
+        0x0020850200244012ULL, 0x0020850200244012ULL, 0x0000102001040841ULL, 0x140900040A100021ULL,
+        0x000200282410A102ULL, 0x000200282410A102ULL, 0x000200282410A102ULL, 0x4048240043802106ULL
+    };
+    
+    constexpr Bitboard BishopMagicNumbers[SQUARE_NB] = {
+        0x40106000A1160020ULL, 0x0020010250810120ULL, 0x2010010220280081ULL, 0x002806004050C040ULL,
+        0x0002021018000000ULL, 0x2001112010000400ULL, 0x0881010120218080ULL, 0x1030820110010500ULL,
+        0x0000120222042400ULL, 0x2000020404040044ULL, 0x8000480094208000ULL, 0x0003422A02000001ULL,
+        0x000A220210100040ULL, 0x8004820202226000ULL, 0x0018234854100800ULL, 0x0100004042101040ULL,
+        0x0004001004082820ULL, 0x0010000810010048ULL, 0x1014004208081300ULL, 0x2080818802044202ULL,
+        0x0040880C00A00100ULL, 0x0080400200522010ULL, 0x0001000188180B04ULL, 0x0080249202020204ULL,
+        0x1004400004100410ULL, 0x00013100A0022206ULL, 0x2148500001040080ULL, 0x4241080011004300ULL,
+        0x4020848004002000ULL, 0x10101380D1004100ULL, 0x0008004422020284ULL, 0x01010A1041008080ULL,
+        0x0808080400082121ULL, 0x0808080400082121ULL, 0x0091128200100C00ULL, 0x0202200802010104ULL,
+        0x8C0A020200440085ULL, 0x01A0008080B10040ULL, 0x0889520080122800ULL, 0x100902022202010AULL,
+        0x04081A0816002000ULL, 0x0000681208005000ULL, 0x8170840041008802ULL, 0x0A00004200810805ULL,
+        0x0830404408210100ULL, 0x2602208106006102ULL, 0x1048300680802628ULL, 0x2602208106006102ULL,
+        0x0602010120110040ULL, 0x0941010801043000ULL, 0x000040440A210428ULL, 0x0008240020880021ULL,
+        0x0400002012048200ULL, 0x00AC102001210220ULL, 0x0220021002009900ULL, 0x84440C080A013080ULL,
+        0x0001008044200440ULL, 0x0004C04410841000ULL, 0x2000500104011130ULL, 0x1A0C010011C20229ULL,
+        0x0044800112202200ULL, 0x0434804908100424ULL, 0x0300404822C08200ULL, 0x48081010008A2A80ULL
+    };
+    
+    // The helpers below are constexpr so that the tables can be computed by
+    // the compiler. They are not meant to be fast.
+    
+    constexpr Bitboard square_bb(Square_int s) {
+        return 1ULL << s;
+    }
+    
+    constexpr int count_bits(Bitboard b) {
+        int n = 0;
+        for ( ; b; b &= b - 1)
+            ++n;
+        return n;
+    }
+    
+    // destination() returns the square reached from 's' by the given step, or
+    // SQ_NONE if the step leaves the board (or wraps around one of its edges).
+    constexpr Square_int destination(Square_int s, int step) {
+        const Square_int to = Square_int(s + step);
+        return is_ok(to) && distance(s, to) <= 2 ? to : SQ_NONE;
+    }
+    
+    constexpr Direction RookDirections[] = { NORTH, EAST, SOUTH, WEST };
+    constexpr Direction BishopDirections[] = { NORTH_EAST, SOUTH_EAST, SOUTH_WEST, NORTH_WEST };
+    
+    constexpr Bitboard sliding_attack(PieceType pt, Square_int sq, Bitboard occupied) {
+        Bitboard attack = 0;
+        
+        for (int i = 0; i < 4; ++i) {
+            const Direction d = pt == ROOK ? RookDirections[i] : BishopDirections[i];
+            
+            for (Square_int s = destination(sq, d); s != SQ_NONE; s = destination(s, d)) {
+                attack |= square_bb(s);
+                
+                if (occupied & square_bb(s))
+                    break;
+            }
+        }
+        
+        return attack;
+    }
+    
+    constexpr std::array<Bitboard, SQUARE_NB> init_square_bb() {
+        std::array<Bitboard, SQUARE_NB> bb{};
+        for (Square_int s = SQ_A1; s <= SQ_H8; ++s)
+            bb[s] = square_bb(s);
+        return bb;
+    }
+    
+    constexpr std::array<Bitboard, FILE_NB> init_file_bb() {
+        std::array<Bitboard, FILE_NB> bb{};
+        for (File f = FILE_A; f <= FILE_H; ++f)
+            bb[f] = FileABB << f;
+        return bb;
+    }
+    
+    constexpr std::array<Bitboard, RANK_NB> init_rank_bb() {
+        std::array<Bitboard, RANK_NB> bb{};
+        for (Rank r = RANK_1; r <= RANK_8; ++r)
+            bb[r] = Rank1BB << (8 * r);
+        return bb;
+    }
+    
+    constexpr std::array<std::array<Bitboard, SQUARE_NB>, PIECE_TYPE_NB> init_pseudo_attacks() {
+        std::array<std::array<Bitboard, SQUARE_NB>, PIECE_TYPE_NB> attacks{};
+        
+        for (Square_int s = SQ_A1; s <= SQ_H8; ++s) {
+            for (int step : { -17, -15, -10, -6, 6, 10, 15, 17 })
+                if (destination(s, step) != SQ_NONE)
+                    attacks[KNIGHT][s] |= square_bb(destination(s, step));
+            
+            for (int step : { -9, -8, -7, -1, 1, 7, 8, 9 })
+                if (destination(s, step) != SQ_NONE)
+                    attacks[KING][s] |= square_bb(destination(s, step));
+            
+            attacks[BISHOP][s] = sliding_attack(BISHOP, s, 0);
+            attacks[ROOK][s]   = sliding_attack(ROOK, s, 0);
+            attacks[QUEEN][s]  = attacks[BISHOP][s] | attacks[ROOK][s];
+        }
+        
+        return attacks;
+    }
+    
+    constexpr std::array<std::array<Bitboard, SQUARE_NB>, COLOR_NB> init_pawn_attacks() {
+        std::array<std::array<Bitboard, SQUARE_NB>, COLOR_NB> attacks{};
+        
+        for (Color c = WHITE; c <= BLACK; ++c)
+            for (Square_int s = SQ_A1; s <= SQ_H8; ++s)
+                for (int step : { 7, 9 })
+                    if (destination(s, c == WHITE ? step : -step) != SQ_NONE)
+                        attacks[c][s] |= square_bb(destination(s, c == WHITE ? step : -step));
+        
+        return attacks;
+    }
+    
+    // init_line_bb() computes LineBB (Between = false) or BetweenBB (Between = true)
+    template<bool Between>
+    constexpr std::array<std::array<Bitboard, SQUARE_NB>, SQUARE_NB> init_line_bb() {
+        std::array<std::array<Bitboard, SQUARE_NB>, SQUARE_NB> bb{};
+        
+        for (Square_int s1 = SQ_A1; s1 <= SQ_H8; ++s1)
+            for (Square_int s2 = SQ_A1; s2 <= SQ_H8; ++s2)
+                for (PieceType pt : { BISHOP, ROOK })
+                    if (sliding_attack(pt, s1, 0) & square_bb(s2))
+                        bb[s1][s2] = Between ? sliding_attack(pt, s1, square_bb(s2)) & sliding_attack(pt, s2, square_bb(s1))
+                                             : (sliding_attack(pt, s1, 0) & sliding_attack(pt, s2, 0)) | square_bb(s1) | square_bb(s2);
+        
+        return bb;
+    }
+    
+    // init_magics() computes the masks, shifts and table offsets of the magic
+    // bitboards. As a reference see www.chessprogramming.org/Magic_Bitboards. In
+    // particular, here we use the so called "fancy" approach. When compiled with
+    // USE_PEXT the magic multiply is replaced by the BMI2 pext instruction and
+    // the magic numbers are not used.
+    constexpr std::array<Magic, SQUARE_NB> init_magics(PieceType pt, Bitboard table[], const Bitboard magicNumbers[]) {
+        std::array<Magic, SQUARE_NB> magics{};
+        
+        for (Square_int s = SQ_A1; s <= SQ_H8; ++s) {
+            // Board edges are not considered in the relevant occupancies
+            const Bitboard edges = ((Rank1BB | Rank8BB) & ~(Rank1BB << (8 * rank_of(s))))
+                                 | ((FileABB | FileHBB) & ~(FileABB << file_of(s)));
+            
+            // Given a square 's', the mask is the bitboard of sliding attacks from
+            // 's' computed on an empty board. The index must be big enough to contain
+            // all the attacks for each possible subset of the mask and so is 2 power
+            // the number of 1s of the mask. Hence we deduce the size of the shift to
+            // apply to the 64 bits word to get the index.
+            Magic& m = magics[s];
+            m.mask  = sliding_attack(pt, s, 0) & ~edges;
+            m.magic = magicNumbers[s];
+            m.shift = 64 - count_bits(m.mask);
+            
+            // Set the offset for the attacks table of the square. We have individual
+            // table sizes for each square with "Fancy Magic Bitboards".
+            m.attacks = s == SQ_A1 ? table : magics[s - 1].attacks + (1 << count_bits(magics[s - 1].mask));
+        }
+        
+        return magics;
+    }
+    
+} // namespace
+
 
+constexpr std::array<Bitboard, SQUARE_NB> SquareBB = init_square_bb();
+constexpr std::array<Bitboard, FILE_NB> FileBB = init_file_bb();
+constexpr std::array<Bitboard, RANK_NB> RankBB = init_rank_bb();
+constexpr std::array<std::array<Bitboard, SQUARE_NB>, PIECE_TYPE_NB> PseudoAttacks = init_pseudo_attacks();
+constexpr std::array<std::array<Bitboard, SQUARE_NB>, COLOR_NB> PawnAttacks = init_pawn_attacks();
+constexpr std::array<std::array<Bitboard, SQUARE_NB>, SQUARE_NB> BetweenBB = init_line_bb<true>();
+constexpr std::array<std::array<Bitboard, SQUARE_NB>, SQUARE_NB> LineBB = init_line_bb<false>();
 
-/// Bitboards::init() initializes various bitboard tables. It is called at
-/// startup and relies on global objects to be already zero-initialized.
+constexpr std::array<Magic, SQUARE_NB> RookMagics = init_magics(ROOK, RookTable, RookMagicNumbers);
+constexpr std::array<Magic, SQUARE_NB> BishopMagics = init_magics(BISHOP, BishopTable, BishopMagicNumbers);
+
+// A few spot checks, which also guarantee that the tables above are constant
+// initialized rather than computed when the program starts.
+static_assert(SquareBB[SQ_H8] == 0x8000000000000000ULL, "SquareBB is not a compile-time table");
+static_assert(FileBB[FILE_C] == FileCBB && RankBB[RANK_6] == Rank6BB, "FileBB/RankBB are not compile-time tables");
+static_assert(PseudoAttacks[KNIGHT][SQ_A1] == (SquareBB[SQ_B3] | SquareBB[SQ_C2]), "PseudoAttacks is not a compile-time table");
+static_assert(PseudoAttacks[KING][SQ_H8] == (SquareBB[SQ_G8] | SquareBB[SQ_G7] | SquareBB[SQ_H7]), "PseudoAttacks is not a compile-time table");
+static_assert(PawnAttacks[BLACK][SQ_A7] == SquareBB[SQ_B6], "PawnAttacks is not a compile-time table");
+static_assert(BetweenBB[SQ_C4][SQ_F7] == (SquareBB[SQ_D5] | SquareBB[SQ_E6]), "BetweenBB is not a compile-time table");
+static_assert(LineBB[SQ_A1][SQ_C3] == 0x8040201008040201ULL, "LineBB is not a compile-time table");
+static_assert(RookMagics[SQ_H8].attacks + (1 << (64 - RookMagics[SQ_H8].shift)) == RookTable + 0x19000, "RookTable size mismatch");
+static_assert(BishopMagics[SQ_H8].attacks + (1 << (64 - BishopMagics[SQ_H8].shift)) == BishopTable + 0x1480, "BishopTable size mismatch");
+
+
+/// Bitboards::init() fills the slider attack tables pointed to by RookMagics
+/// and BishopMagics. Everything else is computed at compile time. It is called
+/// at startup and relies on global objects to be already zero-initialized.
 
 void Bitboards::init() {
     
-    for (Square_int s = SQ_A1; s <= SQ_H8; ++s)
-        SquareBB[s] = (1ULL << s);
-    
-    for (File f = FILE_A; f <= FILE_H; ++f)
-        FileBB[f] = f > FILE_A ? FileBB[f - 1] << 1 : FileABB;
-    
-    for (Rank r = RANK_1; r <= RANK_8; ++r)
-        RankBB[r] = r > RANK_1 ? RankBB[r - 1] << 8 : Rank1BB;
-    
+    for (PieceType pt : { BISHOP, ROOK })
+        for (Square_int s = SQ_A1; s <= SQ_H8; ++s) {
+            const Magic& m = pt == ROOK ? RookMagics[s] : BishopMagics[s];
+            const Direction* directions = pt == ROOK ? RookDirections : BishopDirections;
+            
+            // Rays from 's' to the board edge, one per direction. The attack along
+            // a ray stops at the nearest blocker, which is the lowest bit for the
+            // directions going up the board and the highest for the other ones.
+            Bitboard rays[4] = {};
+            for (int i = 0; i < 4; ++i)
+                for (Square_int to = destination(s, directions[i]); to != SQ_NONE; to = destination(to, directions[i]))
+                    rays[i] |= to;
+            
+            // Use Carry-Rippler trick to enumerate all subsets of m.mask and store
+            // the corresponding sliding attack bitboard in m.attacks[].
+            Bitboard b = 0;
+            do {
+                Bitboard attack = 0;
+                
+                for (int i = 0; i < 4; ++i) {
+                    const Bitboard blockers = rays[i] & b;
+                    
+                    if (!blockers)
+                        attack |= rays[i];
+                    else {
+                        const Square_int nearest = directions[i] > 0 ? lsb(blockers) : msb(blockers);
+                        attack |= between_bb(s, nearest) | nearest;
+                    }
+                }
+                
+                assert(!m.attacks[m.index(b)] || m.attacks[m.index(b)] == attack);  // Bad magic number
+                
+                m.attacks[m.index(b)] = attack;
+                b = (b - m.mask) & m.mask;
+            } while (b);
+        }
 }
@@ -1,6 +1,13 @@
 #ifndef BITBOARD_H_INCLUDED
 #define BITBOARD_H_INCLUDED
 
+#if defined(_MSC_VER)
+#  include <intrin.h>    // Microsoft header for _BitScanForward64()
+#  include <nmmintrin.h> // Intel and Microsoft header for _mm_popcnt_u64()
+#endif
+
+#include <array>
+
 #include "types.h"
 
 namespace Bitboards {
@@ -30,9 +37,40 @@ constexpr Bitboard Rank6BB = Rank1BB << (8 * 5);
 constexpr Bitboard Rank7BB = Rank1BB << (8 * 6);
 constexpr Bitboard Rank8BB = Rank1BB << (8 * 7);
 
-extern Bitboard SquareBB[SQUARE_NB];
-extern Bitboard FileBB[FILE_NB];
-extern Bitboard RankBB[RANK_NB];
+/// The tables below are computed at compile time by constexpr functions in
+/// bitboard.cpp and are placed in read-only data.
+
+extern const std::array<Bitboard, SQUARE_NB> SquareBB;
+extern const std::array<Bitboard, FILE_NB> FileBB;
+extern const std::array<Bitboard, RANK_NB> RankBB;
+extern const std::array<std::array<Bitboard, SQUARE_NB>, PIECE_TYPE_NB> PseudoAttacks;
+extern const std::array<std::array<Bitboard, SQUARE_NB>, COLOR_NB> PawnAttacks;
+extern const std::array<std::array<Bitboard, SQUARE_NB>, SQUARE_NB> BetweenBB;
+extern const std::array<std::array<Bitboard, SQUARE_NB>, SQUARE_NB> LineBB;
+
+
+/// Magic holds all magic bitboards relevant data for a single square. Masks,
+/// magic numbers and table offsets are compile-time constants; only the attack
+/// tables they point to are filled by Bitboards::init().
+
+struct Magic {
+  Bitboard  mask;
+  Bitboard  magic;
+  Bitboard* attacks;
+  unsigned  shift;
+
+  // Compute the attack's index using the 'magic bitboards' approach
+  unsigned index(Bitboard occupied) const {
+
+    if (HasPext)
+        return unsigned(pext(occupied, mask));
+
+    return unsigned(((occupied & mask) * magic) >> shift);
+  }
+};
+
+extern const std::array<Magic, SQUARE_NB> RookMagics;
+extern const std::array<Magic, SQUARE_NB> BishopMagics;
 
 
 /// Overloads of bitwise operators between a Bitboard and a Square_int for testing
@@ -63,4 +101,190 @@ inline Bitboard& operator^=(Bitboard& b, Square_int s) {
   return b ^= SquareBB[s];
 }
 
+constexpr bool more_than_one(Bitboard b) {
+  return b & (b - 1);
+}
+
+
+/// shift() moves a bitboard one step along direction D. Mainly for pawns
+
+template<Direction D>
+constexpr Bitboard shift(Bitboard b) {
+  return  D == NORTH      ?  b             << 8 : D == SOUTH      ?  b             >> 8
+        : D == EAST       ? (b & ~FileHBB) << 1 : D == WEST       ? (b & ~FileABB) >> 1
+        : D == NORTH_EAST ? (b & ~FileHBB) << 9 : D == NORTH_WEST ? (b & ~FileABB) << 7
+        : D == SOUTH_EAST ? (b & ~FileHBB) >> 7 : D == SOUTH_WEST ? (b & ~FileABB) >> 9
+        : 0;
+}
+
+
+/// pawn_attacks_bb() returns the squares attacked by pawns of the given color
+/// from the squares in the given bitboard.
+
+template<Color C>
+constexpr Bitboard pawn_attacks_bb(Bitboard b) {
+  return C == WHITE ? shift<NORTH_WEST>(b) | shift<NORTH_EAST>(b)
+                    : shift<SOUTH_WEST>(b) | shift<SOUTH_EAST>(b);
+}
+
+
+/// pawn_double_attacks_bb() returns the squares doubly attacked by pawns of the
+/// given color from the squares in the given bitboard.
+
+template<Color C>
+constexpr Bitboard pawn_double_attacks_bb(Bitboard b) {
+  return C == WHITE ? shift<NORTH_WEST>(b) & shift<NORTH_EAST>(b)
+                    : shift<SOUTH_WEST>(b) & shift<SOUTH_EAST>(b);
+}
+
+
+/// rank_bb() and file_bb() return a bitboard representing all the squares on
+/// the given file or rank.
+
+inline Bitboard rank_bb(Rank r) {
+  return RankBB[r];
+}
+
+inline Bitboard rank_bb(Square_int s) {
+  return RankBB[rank_of(s)];
+}
+
+inline Bitboard file_bb(File f) {
+  return FileBB[f];
+}
+
+inline Bitboard file_bb(Square_int s) {
+  return FileBB[file_of(s)];
+}
+
+
+/// between_bb() returns a bitboard representing all the squares between the two
+/// given ones. For instance, between_bb(SQ_C4, SQ_F7) returns a bitboard with
+/// the bits for squares d5 and e6 set. If s1 and s2 are not on the same rank,
+/// file or diagonal, 0 is returned.
+
+inline Bitboard between_bb(Square_int s1, Square_int s2) {
+  return BetweenBB[s1][s2];
+}
+
+
+/// line_bb() returns a bitboard representing the entire line (from board edge
+/// to board edge) that intersects the two given squares. If the given squares
+/// are not on a same file/rank/diagonal, it returns 0.
+
+inline Bitboard line_bb(Square_int s1, Square_int s2) {
+  return LineBB[s1][s2];
+}
+
+
+/// aligned() returns true if the squares s1, s2 and s3 are aligned either on a
+/// straight or on a diagonal line.
+
+inline bool aligned(Square_int s1, Square_int s2, Square_int s3) {
+  return LineBB[s1][s2] & s3;
+}
+
+
+/// distance() functions return the distance between x and y, defined as the
+/// number of steps for a king in x to reach y.
+
+template<typename T> constexpr int distance(T x, T y) { return x < y ? y - x : x - y; }
+
+template<> constexpr int distance<Square_int>(Square_int x, Square_int y) {
+  return std::max(distance(file_of(x), file_of(y)), distance(rank_of(x), rank_of(y)));
+}
+
+
+/// attacks_bb() returns a bitboard representing all the squares attacked by a
+/// slider of type Pt (bishop, rook or queen) placed on 's', given the board
+/// occupancy.
+
+template<PieceType Pt>
+inline Bitboard attacks_bb(Square_int s, Bitboard occupied) {
+
+  assert(Pt == BISHOP || Pt == ROOK);
+  const Magic& m = Pt == ROOK ? RookMagics[s] : BishopMagics[s];
+  return m.attacks[m.index(occupied)];
+}
+
+template<>
+inline Bitboard attacks_bb<QUEEN>(Square_int s, Bitboard occupied) {
+  return attacks_bb<BISHOP>(s, occupied) | attacks_bb<ROOK>(s, occupied);
+}
+
+inline Bitboard attacks_bb(PieceType pt, Square_int s, Bitboard occupied) {
+
+  assert(pt != PAWN);
+
+  switch (pt)
+  {
+  case BISHOP: return attacks_bb<BISHOP>(s, occupied);
+  case ROOK  : return attacks_bb<  ROOK>(s, occupied);
+  case QUEEN : return attacks_bb<QUEEN >(s, occupied);
+  default    : return PseudoAttacks[pt][s];
+  }
+}
+
+
+/// popcount() counts the number of non-zero bits in a bitboard
+
+inline int popcount(Bitboard b) {
+
+#if defined(_MSC_VER) || defined(__INTEL_COMPILER)
+
+  return (int)_mm_popcnt_u64(b);
+
+#else // Assumed gcc or compatible compiler
+
+  return __builtin_popcountll(b);
+
+#endif
+}
+
+
+/// lsb() and msb() return the least/most significant bit in a non-zero bitboard
+
+#if defined(__GNUC__)  // GCC, Clang, ICC
+
+inline Square_int lsb(Bitboard b) {
+  assert(b);
+  return Square_int(__builtin_ctzll(b));
+}
+
+inline Square_int msb(Bitboard b) {
+  assert(b);
+  return Square_int(63 ^ __builtin_clzll(b));
+}
+
+#elif defined(_MSC_VER)  // MSVC
+
+inline Square_int lsb(Bitboard b) {
+  assert(b);
+  unsigned long idx;
+  _BitScanForward64(&idx, b);
+  return (Square_int) idx;
+}
+
+inline Square_int msb(Bitboard b) {
+  assert(b);
+  unsigned long idx;
+  _BitScanReverse64(&idx, b);
+  return (Square_int) idx;
+}
+
+#else  // Compiler is neither GCC nor MSVC compatible
+
+#error "Compiler not supported."
+
+#endif
+
+
+/// pop_lsb() finds and clears the least significant bit in a non-zero bitboard
+
+inline Square_int pop_lsb(Bitboard* b) {
+  const Square_int s = lsb(*b);
+  *b &= *b - 1;
+  return s;
+}
+
 #endif // #ifndef BITBOARD_H_INCLUDED
@@ -1,23 +1,38 @@
 #ifndef BOARD_H_INCLUDED
 #define BOARD_H_INCLUDED
 
+#include "bitboard.h"
 #include "types.h"
 
 class Position;
 
-SquareList pawn_attacks_from(const Position& pos, int file, int rank);
-SquareList knight_attacks_from(int file, int rank);
-SquareList rook_attacks_from(const Position& pos, int file, int rank);
-SquareList bishop_attacks_from(const Position& pos, int file, int rank);
-SquareList queen_attacks_from(const Position& pos, int file, int rank);
-SquareList king_attacks_from(/*const Position& pos,*/ int file, int rank);
+Bitboard pawn_attacks_from(const Position& pos, Square_int s);
+Bitboard rook_attacks_from(const Position& pos, Square_int s);
+Bitboard bishop_attacks_from(const Position& pos, Square_int s);
+Bitboard queen_attacks_from(const Position& pos, Square_int s);
 
 //template <PieceType Pt>
-SquareList figure_attacks_from(const PieceType Pt, const Position& pos, int file, int rank);
+Bitboard figure_attacks_from(const PieceType Pt, const Position& pos, Square_int s);
 
-VectorSquareList* figure_attacks_behind_king_from(const PieceType Pt, const Position& pos, int file, int rank, VectorSquareList* asbk);
+Bitboard figure_attacks_behind_king_from(const PieceType Pt, const Position& pos, Square_int s);
 
-VectorSquareList between(const Square& s1, const Square& s2);
-bool aligned(const Square& s1, const Square& s2, const Square& s3);
+
+/// Leaper attacks don't depend on the board occupancy, so they are a single
+/// table lookup.
+
+inline Bitboard pawn_attacks_from(Color c, Square_int s)
+{
+    return PawnAttacks[c][s];
+}
+
+inline Bitboard knight_attacks_from(Square_int s)
+{
+    return PseudoAttacks[KNIGHT][s];
+}
+
+inline Bitboard king_attacks_from(/*const Position& pos,*/ Square_int s)
+{
+    return PseudoAttacks[KING][s];
+}
 
 #endif // #ifndef BOARD_H_INCLUDED
@@ -23,7 +23,7 @@ int main(int argc, char* argv[])
     LOG::openFile();
     LOG::log(argc, argv);
     
-    UCI::loop();
+    UCI::loop(argc, argv);
     
     LOG::closeFile();
     return 0;
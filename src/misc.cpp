@@ -1,5 +1,9 @@
 #include <sstream>
 
+#if defined(_MSC_VER) && !defined(NO_PREFETCH)
+#  include <xmmintrin.h> // Header for _mm_prefetch()
+#endif
+
 #include "misc.h"
 
 using namespace std;
@@ -20,3 +24,25 @@ const string engine_info(bool to_uci)
     
     return ss.str();
 }
+
+
+/// prefetch() preloads the given address in L1/L2 cache. This is a non-blocking
+/// function that doesn't stall the CPU waiting for data to be loaded from memory,
+/// which can be quite slow.
+
+#ifdef NO_PREFETCH
+
+void prefetch(void*) {}
+
+#else
+
+void prefetch(void* addr)
+{
+#  if defined(_MSC_VER)
+    _mm_prefetch((char*)addr, _MM_HINT_T0);
+#  else
+    __builtin_prefetch(addr);
+#  endif
+}
+
+#endif
@@ -1,8 +1,39 @@
 #ifndef MISC_H_INCLUDED
 #define MISC_H_INCLUDED
 
+#include <cassert>
+#include <cstdint>
 #include <string>
 
 const std::string engine_info(bool to_uci = false);
+void prefetch(void* addr);
+
+
+/// xorshift64star Pseudo-Random Number Generator
+/// This class is based on original code written and dedicated
+/// to the public domain by Sebastiano Vigna (2014).
+/// It has the following characteristics:
+///
+///  -  Outputs 64-bit numbers
+///  -  Passes Dieharder and SmallCrush test batteries
+///  -  Does not require warm-up, no zeroland to escape
+///  -  Internal state is a single 64-bit integer
+///  -  Period is 2^64 - 1
+///  -  Usable in constant expressions, to generate tables at compile time
+
+class PRNG {
+    
+    uint64_t s;
+    
+    constexpr uint64_t rand64() {
+        s ^= s >> 12, s ^= s << 25, s ^= s >> 27;
+        return s * 2685821657736338717LL;
+    }
+    
+public:
+    constexpr PRNG(uint64_t seed) : s(seed) { assert(seed); }
+    
+    template<typename T> constexpr T rand() { return T(rand64()); }
+};
 
 #endif // #ifndef MISC_H_INCLUDED
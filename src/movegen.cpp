@@ -5,8 +5,8 @@
 
 namespace {
     
-    template<CastlingRight Cr>
-    ExtMove* generate_castling(const Position& pos, ExtMove* moveList, Color us)
+    template<CastlingRight Cr, bool Checks>
+    ExtMove* generate_castling(const Position& pos, ExtMove* moveList, Color us, Bitboard danger)
     {
         constexpr bool KingSide = (Cr == WHITE_OO || Cr == BLACK_OO);
         
@@ -19,209 +19,319 @@ namespace {
         Square_int rfrom = pos.castling_rook_square(Cr);
         Square_int kto = relative_square(us, KingSide ? SQ_G1 : SQ_C1);
         
-        //assert(!pos.checkers());
-        assert(!pos.in_check());
+        assert(!pos.checkers());
         
         const Direction step = KingSide ? WEST : EAST;
         
         for (Square_int s = kto; s != kfrom; s += step)
-            if (pos.get_square_attackers_count(~us, file_of(s), rank_of(s)))  // new 2019-01-06
+            if (danger & s)
                 return moveList;
         
         // Castling is encoded as "king captures friendly rook"
-        Move m (kfrom, rfrom, CASTLING);
+        Move m = make<CASTLING>(kfrom, rfrom);
+        
+        if (Checks && !pos.gives_check(m))
+            return moveList;
         
         *moveList++ = m;
         return moveList;
     }
     
-    template<Color Us>
-    ExtMove* check_generate_pawn_capture(const Position& pos, ExtMove* moveList, int ourRank7, int file, int rank, int to_file, int to_rank)
+    template<GenType Type, Direction D>
+    ExtMove* make_promotions(ExtMove* moveList, Square_int to, Square_int ksq)
     {
-        Piece pc = pos.piece_on(to_file, to_rank);
-        if (    ((pc != NO_PIECE) && (color_of(pc) != Us))      ||      // Standard captures
-                ((pc == NO_PIECE) && ( make_square(File(to_file), Rank(to_rank)) == pos.ep_square() ))   )  {   // En-passant captures
-            if (rank != ourRank7)  // No promotions
-                *moveList++ = Move( Square(file, rank), Square(to_file, to_rank) );
-            else {                 // Promotions
-                for (PieceType pt : {
-                            KNIGHT, BISHOP, ROOK, QUEEN
-                        })
-                    *moveList++ = Move( Square(file, rank), Square(to_file, to_rank), pt );
-            }
+        // Queen promotions are generated with the captures, underpromotions
+        // with the quiet moves. Knight promotions are the only quiet checks,
+        // queen promotions being considered captures.
+        if (Type == CAPTURES || Type == EVASIONS || Type == NON_EVASIONS || Type == LEGAL)
+            *moveList++ = make<PROMOTION>(to - D, to, QUEEN);
+        
+        if (Type == QUIETS || Type == EVASIONS || Type == NON_EVASIONS || Type == LEGAL) {
+            *moveList++ = make<PROMOTION>(to - D, to, ROOK);
+            *moveList++ = make<PROMOTION>(to - D, to, BISHOP);
+            *moveList++ = make<PROMOTION>(to - D, to, KNIGHT);
         }
+        
+        if (Type == QUIET_CHECKS && (knight_attacks_from(to) & ksq))
+            *moveList++ = make<PROMOTION>(to - D, to, KNIGHT);
+        
         return moveList;
     }
     
-    template<Color Us/*, GenType Type*/>
-    ExtMove* generate_pawn_moves(const Position& pos, ExtMove* moveList)
+    /// generate_pawn_moves() generates the moves of the given pawns. With LEGAL
+    /// the target already excludes illegal destinations, and en passant captures
+    /// are left to the caller, which has to test them for discovered checks.
+    
+    template<Color Us, GenType Type>
+    ExtMove* generate_pawn_moves(const Position& pos, ExtMove* moveList, Bitboard pawns, Bitboard target)
     {
-        int ourRank2, ourRank7, up;
-        Piece ourPawn;
-        switch (Us) {
-        case WHITE:
-            ourRank2 = RANK_2;
-            ourRank7 = RANK_7;
-            up = 1;
-            ourPawn = W_PAWN;
-            break;
-        case BLACK:
-            ourRank2 = RANK_7;
-            ourRank7 = RANK_2;
-            up = -1;
-            ourPawn = B_PAWN;
-            break;
-        }
+        constexpr Color     Them     = ~Us;
+        constexpr Bitboard  TRank8BB = (Us == WHITE ? Rank8BB    : Rank1BB);
+        constexpr Bitboard  TRank7BB = (Us == WHITE ? Rank7BB    : Rank2BB);
+        constexpr Bitboard  TRank3BB = (Us == WHITE ? Rank3BB    : Rank6BB);
+        constexpr Direction Up       = (Us == WHITE ? NORTH      : SOUTH);
+        constexpr Direction UpRight  = (Us == WHITE ? NORTH_EAST : SOUTH_WEST);
+        constexpr Direction UpLeft   = (Us == WHITE ? NORTH_WEST : SOUTH_EAST);
         
-        for (int f = 0; f < 8; ++f)
-            for (int r = 1; r < 7; ++r) {
-                if ( pos.piece_on(f, r) == ourPawn ) {
-                    
-                    if ( pos.piece_on(f, r + up) == NO_PIECE ) {
-                        // Single pawn pushes
-                        if (r != ourRank7)  // No promotions
-                            *moveList++ = Move( Square(f, r), Square(f, r + up) );
-                        else {              // Promotions
-                            for (PieceType pt : {
-                                        KNIGHT, BISHOP, ROOK, QUEEN
-                                    })
-                                *moveList++ = Move( Square(f, r), Square(f, r + up), pt );
-                        }
-                        
-                        // Double pawn pushes
-                        if (( r == ourRank2 ) && ( pos.piece_on(f, r + 2*up) == NO_PIECE ))
-                            *moveList++ = Move( Square(f, r), Square(f, r + 2*up) );
-                    }
+        constexpr bool Restricted = (Type == EVASIONS || Type == LEGAL);
+        
+        Bitboard emptySquares;
+        
+        const Bitboard pawnsOn7    = pawns &  TRank7BB;
+        const Bitboard pawnsNotOn7 = pawns & ~TRank7BB;
+        
+        const Bitboard enemies = (Restricted       ? pos.pieces(Them) & target :
+                                  Type == CAPTURES ? target : pos.pieces(Them));
+        
+        // Single and double pawn pushes, no promotions
+        if (Type != CAPTURES) {
+            emptySquares = (Type == QUIETS || Type == QUIET_CHECKS ? target : ~pos.pieces());
+            
+            Bitboard b1 = shift<Up>(pawnsNotOn7)   & emptySquares;
+            Bitboard b2 = shift<Up>(b1 & TRank3BB) & emptySquares;
+            
+            // Consider only blocking squares
+            if (Restricted) {
+                b1 &= target;
+                b2 &= target;
+            }
+            
+            if (Type == QUIET_CHECKS) {
+                const Square_int ksq = pos.square<KING>(Them);
+                
+                b1 &= pawn_attacks_from(Them, ksq);
+                b2 &= pawn_attacks_from(Them, ksq);
+                
+                // Add pawn pushes which give discovered check. This is possible only
+                // if the pawn is not on the same file as the enemy king, because we
+                // don't generate captures. Note that a possible discovered check
+                // promotion has been already generated amongst the captures.
+                const Bitboard dcCandidates = pos.blockers_for_king(Them);
+                if (pawnsNotOn7 & dcCandidates) {
+                    Bitboard dc1 = shift<Up>(pawnsNotOn7 & dcCandidates) & emptySquares & ~file_bb(ksq);
+                    Bitboard dc2 = shift<Up>(dc1 & TRank3BB) & emptySquares;
                     
-                    // Standard and en-passant captures
-                    if (f > FILE_A)
-                        moveList = check_generate_pawn_capture<Us>(pos, moveList, ourRank7, f, r, f - 1, r + up);
-                    if (f < FILE_H)
-                        moveList = check_generate_pawn_capture<Us>(pos, moveList, ourRank7, f, r, f + 1, r + up);
+                    b1 |= dc1;
+                    b2 |= dc2;
                 }
             }
+            
+            while (b1) {
+                const Square_int to = pop_lsb(&b1);
+                *moveList++ = make_move(to - Up, to);
+            }
+            
+            while (b2) {
+                const Square_int to = pop_lsb(&b2);
+                *moveList++ = make_move(to - Up - Up, to);
+            }
+        }
+        
+        // Promotions and underpromotions
+        if (pawnsOn7 && (!Restricted || (target & TRank8BB))) {
+            if (Type == CAPTURES)
+                emptySquares = ~pos.pieces();
+            
+            if (Restricted)
+                emptySquares &= target;
+            
+            Bitboard b1 = shift<UpRight>(pawnsOn7) & enemies;
+            Bitboard b2 = shift<UpLeft >(pawnsOn7) & enemies;
+            Bitboard b3 = shift<Up     >(pawnsOn7) & emptySquares;
+            
+            const Square_int ksq = pos.square<KING>(Them);
+            
+            while (b1)
+                moveList = make_promotions<Type, UpRight>(moveList, pop_lsb(&b1), ksq);
+            
+            while (b2)
+                moveList = make_promotions<Type, UpLeft >(moveList, pop_lsb(&b2), ksq);
+            
+            while (b3)
+                moveList = make_promotions<Type, Up     >(moveList, pop_lsb(&b3), ksq);
+        }
+        
+        // Standard and en-passant captures
+        if (Type == CAPTURES || Type == EVASIONS || Type == NON_EVASIONS || Type == LEGAL) {
+            Bitboard b1 = shift<UpRight>(pawnsNotOn7) & enemies;
+            Bitboard b2 = shift<UpLeft >(pawnsNotOn7) & enemies;
+            
+            while (b1) {
+                const Square_int to = pop_lsb(&b1);
+                *moveList++ = make_move(to - UpRight, to);
+            }
+            
+            while (b2) {
+                const Square_int to = pop_lsb(&b2);
+                *moveList++ = make_move(to - UpLeft, to);
+            }
+            
+            if (Type != LEGAL && pos.ep_square() != SQ_NONE) {
+                assert(rank_of(pos.ep_square()) == relative_rank(Us, RANK_6));
+                
+                // An en passant capture can be an evasion only if the checking piece
+                // is the double pushed pawn and so is in the target. Otherwise this
+                // is a discovered check and we are forced to do otherwise.
+                if (Type == EVASIONS && !(target & (pos.ep_square() - Up)))
+                    return moveList;
+                
+                b1 = pawns & pawn_attacks_from(Them, pos.ep_square());
+                
+                while (b1)
+                    *moveList++ = make<ENPASSANT>(pop_lsb(&b1), pos.ep_square());
+            }
+        }
         
         return moveList;
     }
     
-    // kbrq = knight, bishop, rook, queen
-    ExtMove* check_generate_kbrq_move(const Position& pos, ExtMove* moveList, Color us,  int file, int rank, int to_file, int to_rank)
+    template<PieceType Pt>
+    Bitboard attacks_from(const Position& pos, Square_int s)
     {
-        Piece pc = pos.piece_on(to_file, to_rank);
-        if (    ( pc == NO_PIECE )  ||
-                ( color_of(pc) != color_of(pos.piece_on(file, rank)) )    )
-            *moveList++ = Move( Square(file, rank), Square(to_file, to_rank) );
-        return moveList;
+        return attacks_bb<Pt>(s, pos.pieces());
     }
     
-    //template<bool Checks>
-    ExtMove* generate_knight_moves(const Position& pos, ExtMove* moveList, Color us, int f, int r)
+    template<>
+    Bitboard attacks_from<KNIGHT>(const Position&, Square_int s)
     {
-        for ( const Square& sq : knight_attacks_from(f, r) ) {
-            moveList = check_generate_kbrq_move(pos, moveList, us, f, r, sq.file, sq.rank);
-        }
-        return moveList;
+        return knight_attacks_from(s);
     }
     
-    //template<bool Checks>
-    ExtMove* generate_bishop_moves(const Position& pos, ExtMove* moveList, Color us, int f, int r)
+    template<Color Us, PieceType Pt, bool Checks>
+    ExtMove* generate_moves(const Position& pos, ExtMove* moveList, Bitboard target, Bitboard pinned = 0)
     {
-        for ( const Square& sq : bishop_attacks_from(pos, f, r) ) {
-            moveList = check_generate_kbrq_move(pos, moveList, us, f, r, sq.file, sq.rank);
+        static_assert(Pt != KING && Pt != PAWN, "Unsupported piece type in generate_moves()");
+        
+        const Square_int* pl = pos.squares<Pt>(Us);
+        
+        for (Square_int from = *pl; from != SQ_NONE; from = *++pl) {
+            if (Checks) {
+                if (    (Pt == BISHOP || Pt == ROOK || Pt == QUEEN)
+                    && !(PseudoAttacks[Pt][from] & target & pos.check_squares(Pt)))
+                    continue;
+                
+                // Discovered checks are generated separately
+                if (pos.blockers_for_king(~Us) & from)
+                    continue;
+            }
+            
+            Bitboard b = attacks_from<Pt>(pos, from) & target;
+            
+            if (Checks)
+                b &= pos.check_squares(Pt);
+            
+            // A pinned piece can only move along the line through its king
+            if (pinned & from)
+                b &= line_bb(pos.square<KING>(Us), from);
+            
+            while (b)
+                *moveList++ = make_move(from, pop_lsb(&b));
         }
+        
         return moveList;
     }
     
-    //template<bool Checks>
-    ExtMove* generate_rook_moves(const Position& pos, ExtMove* moveList, Color us, int f, int r)
+    template<Color Us, GenType Type>
+    ExtMove* generate_king_moves(const Position& pos, ExtMove* moveList, Bitboard target)
     {
-        for ( const Square& sq : rook_attacks_from(pos, f, r) ) {
-            moveList = check_generate_kbrq_move(pos, moveList, us, f, r, sq.file, sq.rank);
+        constexpr bool Checks = Type == QUIET_CHECKS;
+        
+        // The king never gives a direct check, discovered checks are generated
+        // separately.
+        if (!Checks) {
+            const Square_int ksq = pos.square<KING>(Us);
+            Bitboard b =   king_attacks_from(ksq) & target
+                         & ~pos.attacked_by(~Us) & ~pos.attacked_king_squares();
+            
+            while (b)
+                *moveList++ = make_move(ksq, pop_lsb(&b));
+        }
+        
+        if (Type != CAPTURES && Type != EVASIONS && pos.can_castle(Us)) {
+            const Bitboard danger = pos.attacked_by(~Us);
+            moveList = generate_castling< make_castling<Us, KING_SIDE>(), Checks>(pos, moveList, Us, danger);
+            moveList = generate_castling< make_castling<Us, QUEEN_SIDE>(), Checks>(pos, moveList, Us, danger);
         }
         return moveList;
     }
     
-    //template<bool Checks>
-    ExtMove* generate_queen_moves(const Position& pos, ExtMove* moveList, Color us, int f, int r)
+    template<Color Us, GenType Type>
+    ExtMove* generate_all(const Position& pos, ExtMove* moveList, Bitboard target)
     {
-        moveList = generate_rook_moves(pos, moveList, us, f, r);
-        moveList = generate_bishop_moves(pos, moveList, us, f, r);
+        constexpr bool Checks = Type == QUIET_CHECKS;
+        
+        moveList = generate_pawn_moves<Us, Type>(pos, moveList, pos.pieces(Us, PAWN), target);
+        moveList = generate_moves<Us, KNIGHT, Checks>(pos, moveList, target);
+        moveList = generate_moves<Us, BISHOP, Checks>(pos, moveList, target);
+        moveList = generate_moves<Us,   ROOK, Checks>(pos, moveList, target);
+        moveList = generate_moves<Us,  QUEEN, Checks>(pos, moveList, target);
+        
+        if (Type != EVASIONS)
+            moveList = generate_king_moves<Us, Type>(pos, moveList, target);
+        
         return moveList;
     }
     
-    ExtMove* check_generate_king_move(const Position& pos, ExtMove* moveList, Color us,  int file, int rank, int to_file, int to_rank)
-    {
-        Piece pc = pos.piece_on(to_file, to_rank);
-        if (    ( pos.get_square_attackers_count(~us, to_file, to_rank) == 0 )  &&
-                ( !pos.is_king_square_attacked(to_file, to_rank) )  &&
-                ( ( pc == NO_PIECE )  ||  ( color_of(pc) != color_of(pos.piece_on(file, rank)) ) )    )
-            *moveList++ = Move( Square(file, rank), Square(to_file, to_rank) );
-        return moveList;
-    }
+    /// generate_legal() generates all the legal moves in a single pass. The
+    /// squares attacked by the enemy (read from the attack map), the check mask
+    /// and the pinned pieces are computed once, so that every generated move is
+    /// legal by construction.
     
-    template<Color Us/*, bool Checks*/>
-    ExtMove* generate_king_moves(const Position& pos, ExtMove* moveList, /*Color us,*/ int f, int r)
+    template<Color Us>
+    ExtMove* generate_legal(const Position& pos, ExtMove* moveList)
     {
-        for ( const Square& sq : king_attacks_from(f, r) ) {
-            moveList = check_generate_king_move(pos, moveList, Us, f, r, sq.file, sq.rank);
-        }
-        if (!pos.in_check() && pos.can_castle(Us)) {
-            moveList = generate_castling< make_castling<Us, KING_SIDE>() >(pos, moveList, Us);
-            moveList = generate_castling< make_castling<Us, QUEEN_SIDE>() >(pos, moveList, Us);
+        constexpr Color Them = ~Us;
+        
+        const Square_int ksq = pos.square<KING>(Us);
+        const Bitboard checkers = pos.checkers();
+        const Bitboard pinned = pos.blockers_for_king(Us) & pos.pieces(Us);
+        
+        // The squares behind the king on the line of a checking slider are not
+        // in the attack map, because the king itself blocks the ray.
+        const Bitboard danger = pos.attacked_by(Them) | pos.attacked_king_squares();
+        
+        Bitboard b = king_attacks_from(ksq) & ~pos.pieces(Us) & ~danger;
+        while (b)
+            *moveList++ = make_move(ksq, pop_lsb(&b));
+        
+        // Double check, only a king move can save the day
+        if (more_than_one(checkers))
+            return moveList;
+        
+        // In check, the other pieces must block the check or capture the checker
+        const Bitboard target = ~pos.pieces(Us) & (checkers ? between_bb(ksq, lsb(checkers)) | checkers
+                                                            : AllSquares);
+        
+        const Bitboard pawns = pos.pieces(Us, PAWN);
+        
+        moveList = generate_pawn_moves<Us, LEGAL>(pos, moveList, pawns & ~pinned, target);
+        
+        for (b = pawns & pinned; b; ) {
+            const Square_int from = pop_lsb(&b);
+            moveList = generate_pawn_moves<Us, LEGAL>(pos, moveList, SquareBB[from], target & line_bb(ksq, from));
         }
-        return moveList;
-    }
-    
-    template<Color Us, PieceType Pt/*, bool Checks*/>
-    ExtMove* generate_moves(const Position& pos, ExtMove* moveList)
-    {
-        constexpr Piece ourKnight   = (Us == WHITE  ? W_KNIGHT  : B_KNIGHT);
-        constexpr Piece ourBishop   = (Us == WHITE  ? W_BISHOP  : B_BISHOP);
-        constexpr Piece ourRook     = (Us == WHITE  ? W_ROOK    : B_ROOK);
-        constexpr Piece ourQueen    = (Us == WHITE  ? W_QUEEN   : B_QUEEN);
-        constexpr Piece ourKing     = (Us == WHITE  ? W_KING    : B_KING);
-        for (int f = 0; f < 8; ++f)
-            for (int r = 0; r < 8; ++r) {
-                switch (pos.piece_on(f, r)) {
-                case ourKnight:
-                    if (Pt == ALL_PIECES || Pt == KNIGHT)
-                        moveList = generate_knight_moves(pos, moveList, Us, f, r);
-                    break;
-                case ourBishop:
-                    if (Pt == ALL_PIECES || Pt == BISHOP)
-                        moveList = generate_bishop_moves(pos, moveList, Us, f, r);
-                    break;
-                case ourRook:
-                    if (Pt == ALL_PIECES || Pt == ROOK)
-                        moveList = generate_rook_moves(pos, moveList, Us, f, r);
-                    break;
-                case ourQueen:
-                    if (Pt == ALL_PIECES || Pt == QUEEN)
-                        moveList = generate_queen_moves(pos, moveList, Us, f, r);
-                    break;
-                case ourKing:
-                    if (Pt == ALL_PIECES || Pt == KING)
-                        moveList = generate_king_moves<Us>(pos, moveList, /*Us,*/ f, r);
-                    break;
-                default:
-                    break;
-                }
+        
+        // An en passant capture can resolve a check only by capturing the double
+        // pushed pawn. Whether it uncovers a slider attack on our king, by a pin
+        // or along the rank of both pawns, is left to legal().
+        const Square_int ep = pos.ep_square();
+        
+        if (ep != SQ_NONE && (!checkers || checkers == SquareBB[ep - pawn_push(Us)]))
+            for (b = pawns & pawn_attacks_from(Them, ep); b; ) {
+                const Move m = make<ENPASSANT>(pop_lsb(&b), ep);
+                if (pos.legal(m))
+                    *moveList++ = m;
             }
         
-        return moveList;
-    }
-    
-    template<Color Us, GenType Type>
-    ExtMove* generate_all(const Position& pos, ExtMove* moveList)
-    {
-        //constexpr bool Checks = Type == QUIET_CHECKS;
+        moveList = generate_moves<Us, KNIGHT, false>(pos, moveList, target, pinned);
+        moveList = generate_moves<Us, BISHOP, false>(pos, moveList, target, pinned);
+        moveList = generate_moves<Us,   ROOK, false>(pos, moveList, target, pinned);
+        moveList = generate_moves<Us,  QUEEN, false>(pos, moveList, target, pinned);
         
-        moveList = generate_pawn_moves<Us>(pos, moveList);
-        moveList = generate_moves<Us, ALL_PIECES>(pos, moveList);
-        //moveList = generate_moves<KNIGHT, Checks>(pos, moveList, Us);
-        //moveList = generate_moves<BISHOP, Checks>(pos, moveList, Us);
-        //moveList = generate_moves<  ROOK, Checks>(pos, moveList, Us);
-        //moveList = generate_moves< QUEEN, Checks>(pos, moveList, Us);
+        if (!checkers && pos.can_castle(Us)) {
+            moveList = generate_castling< make_castling<Us, KING_SIDE>(), false>(pos, moveList, Us, danger);
+            moveList = generate_castling< make_castling<Us, QUEEN_SIDE>(), false>(pos, moveList, Us, danger);
+        }
         
         return moveList;
     }
@@ -229,53 +339,94 @@ namespace {
 } // namespace
 
 
-bool MOVEGEN::check_move(const Position& pos, Move move)
-{
-    Square from = move.from;
-    //Square to = move.to;
+/// generate<CAPTURES> generates all pseudo-legal captures and queen promotions.
+/// generate<QUIETS> generates all pseudo-legal non-captures and underpromotions.
+/// generate<NON_EVASIONS> generates all pseudo-legal captures and non-captures.
+///
+/// Returns a pointer to the end of the move list.
 
-    Piece piece = pos.piece_on(from);
+template<GenType Type>
+ExtMove* generate(const Position& pos, ExtMove* moveList)
+{
+    static_assert(Type == CAPTURES || Type == QUIETS || Type == NON_EVASIONS, "Unsupported type in generate()");
+    assert(!pos.checkers());
+    
+    Color us = pos.side_to_move();
+    
+    const Bitboard target =  Type == CAPTURES     ?  pos.pieces(~us)
+                           : Type == QUIETS       ? ~pos.pieces()
+                           : Type == NON_EVASIONS ? ~pos.pieces(us) : 0;
+    
+    return us == WHITE  ? generate_all<WHITE, Type>(pos, moveList, target)
+                        : generate_all<BLACK, Type>(pos, moveList, target);
+}
 
-    if (piece != NO_PIECE)
-        return true;
+// Explicit template instantiations
+template ExtMove* generate<CAPTURES>(const Position&, ExtMove*);
+template ExtMove* generate<QUIETS>(const Position&, ExtMove*);
+template ExtMove* generate<NON_EVASIONS>(const Position&, ExtMove*);
 
-    return false;
-}
 
+/// generate<QUIET_CHECKS> generates all pseudo-legal non-captures giving check,
+/// plus the knight underpromotions giving direct check. Returns a pointer to the
+/// end of the move list.
 
-template<GenType Type>
-ExtMove* generate(const Position& pos, ExtMove* moveList)
+template<>
+ExtMove* generate<QUIET_CHECKS>(const Position& pos, ExtMove* moveList)
 {
+    assert(!pos.checkers());
+    
     Color us = pos.side_to_move();
+    Bitboard dc = pos.blockers_for_king(~us) & pos.pieces(us);
+    
+    while (dc) {
+        const Square_int from = pop_lsb(&dc);
+        const PieceType pt = type_of(pos.piece_on(from));
+        
+        if (pt == PAWN)
+            continue; // Will be generated together with direct checks
+        
+        Bitboard b = figure_attacks_from(pt, pos, from) & ~pos.pieces();
+        
+        // A king move along the line to the enemy king does not uncover anything
+        if (pt == KING)
+            b &= ~PseudoAttacks[QUEEN][pos.square<KING>(~us)];
+        
+        while (b)
+            *moveList++ = make_move(from, pop_lsb(&b));
+    }
     
-    return us == WHITE  ? generate_all<WHITE, Type>(pos, moveList)
-                        : generate_all<BLACK, Type>(pos, moveList);
+    return us == WHITE  ? generate_all<WHITE, QUIET_CHECKS>(pos, moveList, ~pos.pieces())
+                        : generate_all<BLACK, QUIET_CHECKS>(pos, moveList, ~pos.pieces());
 }
 
+
+/// generate<EVASIONS> generates all pseudo-legal check evasions when the side
+/// to move is in check. Returns a pointer to the end of the move list.
+
 template<>
 ExtMove* generate<EVASIONS>(const Position& pos, ExtMove* moveList)
 {
-    Color us = pos.side_to_move();
+    assert(pos.checkers());
     
-    ExtMove* cur = moveList;
+    Color us = pos.side_to_move();
+    const Square_int ksq = pos.square<KING>(us);
     
-    moveList = us == WHITE  ? generate_all<WHITE, EVASIONS>(pos, moveList)
-                            : generate_all<BLACK, EVASIONS>(pos, moveList);
+    // King moves are filtered against the attack map, so they need no target
+    // other than the squares not occupied by our own pieces.
+    moveList = us == WHITE  ? generate_king_moves<WHITE, EVASIONS>(pos, moveList, ~pos.pieces(us))
+                            : generate_king_moves<BLACK, EVASIONS>(pos, moveList, ~pos.pieces(us));
     
-    Square ksq = pos.square<KING>(us);
-    VectorSquareList target_sqlist;
-    if (pos.checkers().size() == 1)
-        target_sqlist = between(ksq, pos.checkers().front());
-    target_sqlist.addSquare(pos.checkers().front());
+    // Double check, only a king move can save the day
+    if (more_than_one(pos.checkers()))
+        return moveList;
     
-    while (cur != moveList) {
-        if ((cur->move.from == ksq) || target_sqlist.contains(cur->move.to))
-            ++cur;
-        else
-            *cur = (--moveList)->move;
-    }
+    // Generate blocking evasions or captures of the checking piece
+    const Square_int checksq = lsb(pos.checkers());
+    const Bitboard target = between_bb(ksq, checksq) | checksq;
     
-    return moveList;
+    return us == WHITE  ? generate_all<WHITE, EVASIONS>(pos, moveList, target)
+                        : generate_all<BLACK, EVASIONS>(pos, moveList, target);
 }
 
 
@@ -284,17 +435,6 @@ ExtMove* generate<EVASIONS>(const Position& pos, ExtMove* moveList)
 template<>
 ExtMove* generate<LEGAL>(const Position& pos, ExtMove* moveList)
 {
-    //Color us = pos.side_to_move();
-    
-    ExtMove* cur = moveList;
-    
-    moveList = pos.in_check() ? generate<EVASIONS    >(pos, moveList)
-                              : generate<NON_EVASIONS>(pos, moveList);
-    while (cur != moveList)
-        if (!pos.legal(*cur))
-            *cur = (--moveList)->move;
-        else
-            ++cur;
-    
-    return moveList;
+    return pos.side_to_move() == WHITE  ? generate_legal<WHITE>(pos, moveList)
+                                        : generate_legal<BLACK>(pos, moveList);
 }
@@ -7,10 +7,6 @@
 
 class Position;
 
-namespace MOVEGEN {
-    bool check_move(const Position& pos, Move move);
-}
-
 enum GenType {
     CAPTURES,
     QUIETS,
@@ -22,7 +18,7 @@ enum GenType {
 
 struct ExtMove {
     Move move;
-    //int value;  TODO
+    int value;
 
     operator Move() const { return move; }
     void operator=(Move m) { move = m; }
@@ -32,6 +28,12 @@ struct ExtMove {
     operator float() const = delete;
 };
 
+static_assert(sizeof(ExtMove) == 8, "ExtMove should fit in 8 bytes");
+
+inline bool operator<(const ExtMove& f, const ExtMove& s) {
+    return f.value < s.value;
+}
+
 template<GenType>
 ExtMove* generate(const Position& pos, ExtMove* moveList);
 
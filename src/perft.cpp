@@ -0,0 +1,548 @@
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+#include "perft.h"
+#include "misc.h"
+#include "movegen.h"
+#include "position.h"
+#include "uci.h"
+
+#ifdef USE_COROUTINES
+#  include <coroutine>
+#  include <exception> // For std::terminate
+#  include <utility>   // For std::exchange
+#endif
+
+using namespace std;
+
+namespace {
+    
+    // A Task is the subtree under a sequence of moves from the root. It is
+    // searched on its own Position, set up from the root FEN and the moves.
+    
+    struct Task {
+        Move moves[Perft::MaxSplitDepth];
+        int rootMove;   // Index of the first move in the root move list
+        uint64_t nodes;
+    };
+    
+    
+    // WorkQueue holds the tasks of a worker thread. The owner takes its work
+    // from the back, idle workers steal from the front.
+    
+    class WorkQueue {
+    public:
+        void push(size_t idx)
+        {
+            lock_guard<mutex> lock(m);
+            tasks.push_back(idx);
+        }
+        
+        bool pop(size_t& idx)
+        {
+            lock_guard<mutex> lock(m);
+            if (tasks.empty())
+                return false;
+            
+            idx = tasks.back();
+            tasks.pop_back();
+            return true;
+        }
+        
+        bool steal(size_t& idx)
+        {
+            lock_guard<mutex> lock(m);
+            if (tasks.empty())
+                return false;
+            
+            idx = tasks.front();
+            tasks.pop_front();
+            return true;
+        }
+        
+    private:
+        mutex m;
+        deque<size_t> tasks;
+    };
+    
+    
+    // split() collects the move sequences of the given length below the
+    // position, each one becoming a task.
+    
+    void split(Position& pos, int ply, int splitDepth, Task& task, vector<Task>& tasks)
+    {
+        if (ply >= std::min(splitDepth, Perft::MaxSplitDepth)) {
+            tasks.push_back(task);
+            return;
+        }
+        
+        StateInfo st;
+        
+        for (const auto& m : MoveList<LEGAL>(pos)) {
+            task.moves[ply] = m;
+            pos.do_move(m, st);
+            split(pos, ply + 1, splitDepth, task, tasks);
+            pos.undo_move(m);
+        }
+    }
+    
+    
+    // root_counts() returns the perft count under each move of the root move
+    // list. With more than one thread the tree is split at splitDepth plies into
+    // tasks which are dealt round robin to the workers. A worker runs out its
+    // own queue and then steals from the others, and since all the tasks are
+    // known beforehand, it quits when every queue is empty. The counts are
+    // summed per root move afterwards, so the result does not depend on the
+    // order in which the tasks are run.
+    
+    vector<uint64_t> root_counts(Position& pos, int depth, int threads, int splitDepth)
+    {
+        const MoveList<LEGAL> rootMoves(pos);
+        vector<uint64_t> counts(rootMoves.size(), depth > 1 ? 0 : 1);
+        
+        if (depth <= 1)
+            return counts;
+        
+        StateInfo st;
+        
+        if (threads <= 1) {
+            for (size_t i = 0; i < rootMoves.size(); ++i) {
+                pos.do_move(rootMoves.begin()[i], st);
+                counts[i] = Perft::perft(pos, depth - 1);
+                pos.undo_move(rootMoves.begin()[i]);
+            }
+            return counts;
+        }
+        
+        splitDepth = std::max(1, std::min({ splitDepth, depth - 1, Perft::MaxSplitDepth }));
+        
+        vector<Task> tasks;
+        Task task = {};
+        
+        for (size_t i = 0; i < rootMoves.size(); ++i) {
+            task.rootMove = int(i);
+            task.moves[0] = rootMoves.begin()[i];
+            pos.do_move(task.moves[0], st);
+            split(pos, 1, splitDepth, task, tasks);
+            pos.undo_move(task.moves[0]);
+        }
+        
+        const string fen = pos.fen();
+        vector<WorkQueue> queues(threads);
+        
+        for (size_t idx = 0; idx < tasks.size(); ++idx)
+            queues[idx % threads].push(idx);
+        
+        auto worker = [&](int id) {
+            size_t idx;
+            
+            while (true) {
+                bool found = queues[id].pop(idx);
+                
+                for (int i = 1; !found && i < threads; ++i)
+                    found = queues[(id + i) % threads].steal(idx);
+                
+                if (!found)
+                    break;
+                
+                Task& t = tasks[idx];
+                StateInfo states[Perft::MaxSplitDepth + 1];
+                Position p;
+                p.set(fen, &states[0]);
+                
+                for (int ply = 0; ply < splitDepth; ++ply)
+                    p.do_move(t.moves[ply], states[ply + 1]);
+                
+                t.nodes = Perft::perft(p, depth - splitDepth);
+            }
+        };
+        
+        vector<thread> workers;
+        
+        for (int id = 0; id < threads; ++id)
+            workers.emplace_back(worker, id);
+        
+        for (thread& th : workers)
+            th.join();
+        
+        for (const Task& t : tasks)
+            counts[t.rootMove] += t.nodes;
+        
+        return counts;
+    }
+    
+} // namespace
+
+
+PerftTable Perft::TT; // Empty, that is disabled, until resized
+
+
+/// PerftTable::resize() sets the size of the table in megabytes, rounded down
+/// to a power of two number of entries. A zero size disables the table.
+
+void PerftTable::resize(size_t mb)
+{
+    size_t count = mb * 1024 * 1024 / sizeof(Entry);
+    
+    while (count & (count - 1))
+        count &= count - 1;
+    
+    table.reset(count ? new Entry[count] : nullptr);
+    entryCount = count;
+    mbSize = mb;
+    clear();
+}
+
+
+/// PerftTable::clear() empties the table and resets the statistics
+
+void PerftTable::clear()
+{
+    for (size_t i = 0; i < entryCount; ++i) {
+        table[i].keyXorData.store(0, memory_order_relaxed);
+        table[i].data.store(0, memory_order_relaxed);
+    }
+    
+    probes = hits = 0;
+}
+
+
+/// PerftTable::probe() looks up the leaf count of the position with the given
+/// key at the given depth. Depth 0 is never stored, so an empty entry never
+/// matches.
+
+bool PerftTable::probe(Key key, int depth, uint64_t& nodes) const
+{
+    const Entry& e = entry(key);
+    const uint64_t data = e.data.load(memory_order_relaxed);
+    
+    if ((e.keyXorData.load(memory_order_relaxed) ^ data) != key || int(data & 0xFF) != depth)
+        return false;
+    
+    nodes = data >> 8;
+    return true;
+}
+
+
+/// PerftTable::prefetch() starts loading the entry of the given key into the
+/// cache, to be probed a little later
+
+void PerftTable::prefetch(Key key) const
+{
+    ::prefetch(&entry(key));
+}
+
+
+/// PerftTable::store() saves a leaf count, always replacing the old entry
+
+void PerftTable::store(Key key, int depth, uint64_t nodes)
+{
+    Entry& e = entry(key);
+    const uint64_t data = (nodes << 8) | uint64_t(depth);
+    
+    e.keyXorData.store(key ^ data, memory_order_relaxed);
+    e.data.store(data, memory_order_relaxed);
+}
+
+
+namespace {
+    
+    // count() is the recursive part of perft(). The subtrees of depth 2 and
+    // more are looked up in the table, if enabled, before generating the moves,
+    // so that a hit costs no move generation. The last ply is bulk counted.
+    
+    uint64_t count(Position& pos, int depth, uint64_t& probes, uint64_t& hits)
+    {
+        if (depth == 1)
+            return MoveList<LEGAL>(pos).size();
+        
+        uint64_t nodes = 0;
+        
+        if (Perft::TT.enabled()) {
+            ++probes;
+            
+            if (Perft::TT.probe(pos.key(), depth, nodes)) {
+                ++hits;
+                return nodes;
+            }
+        }
+        
+        StateInfo st;
+        
+        for (const auto& m : MoveList<LEGAL>(pos)) {
+            pos.do_move(m, st);
+            nodes += count(pos, depth - 1, probes, hits);
+            pos.undo_move(m);
+        }
+        
+        if (Perft::TT.enabled())
+            Perft::TT.store(pos.key(), depth, nodes);
+        
+        return nodes;
+    }
+    
+} // namespace
+
+
+/// Perft::perft() counts the leaf nodes of the legal move tree of the given
+/// depth. The last ply is bulk counted: the size of the legal move list is
+/// added instead of making each move.
+
+uint64_t Perft::perft(Position& pos, int depth)
+{
+    if (depth <= 0)
+        return 1;
+    
+    uint64_t probes = 0, hits = 0;
+    uint64_t nodes = count(pos, depth, probes, hits);
+    
+    // Update the shared statistics once per call, not once per probe
+    TT.probes += probes;
+    TT.hits += hits;
+    
+    return nodes;
+}
+
+
+/// Perft::perft() with a thread count runs the same count on a pool of worker
+/// threads, see root_counts().
+
+uint64_t Perft::perft(Position& pos, int depth, int threads, int splitDepth)
+{
+    if (depth <= 0)
+        return 1;
+    
+    vector<uint64_t> counts = root_counts(pos, depth, threads, splitDepth);
+    
+    uint64_t nodes = 0;
+    for (uint64_t cnt : counts)
+        nodes += cnt;
+    
+    return nodes;
+}
+
+
+#ifdef USE_COROUTINES
+
+namespace {
+    
+    // Walk is the coroutine of a subtree walk run by interleaved_perft(). It
+    // starts suspended and suspends again before each table probe, once the
+    // entry has been prefetched, so that the other walks run while the entry
+    // is loaded from memory.
+    
+    struct Walk {
+        struct promise_type {
+            Walk get_return_object() { return Walk(std::coroutine_handle<promise_type>::from_promise(*this)); }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_always final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+        };
+        
+        Walk() = default;
+        explicit Walk(std::coroutine_handle<promise_type> h) : handle(h) {}
+        Walk(Walk&& w) noexcept : handle(std::exchange(w.handle, nullptr)) {}
+        Walk& operator=(Walk&& w) noexcept
+        {
+            if (handle)
+                handle.destroy();
+            handle = std::exchange(w.handle, nullptr);
+            return *this;
+        }
+        ~Walk() { if (handle) handle.destroy(); }
+        
+        explicit operator bool() const { return bool(handle); }
+        bool done() const { return handle.done(); }
+        void resume() const { handle.resume(); }
+        
+    private:
+        std::coroutine_handle<promise_type> handle = nullptr;
+    };
+    
+    
+    // A Frame is a ply of the explicit stack of walk()
+    
+    struct Frame {
+        ExtMove moves[MAX_MOVES], *cur, *end;
+        uint64_t nodes;
+        bool hit;
+    };
+    
+    
+    // walk() counts the leaves of the given depth under pos, as count() does,
+    // but iteratively with its own stack of move lists, so that it can suspend
+    // at any ply.
+    
+    Walk walk(Position& pos, int depth, uint64_t& result, uint64_t& probes, uint64_t& hits)
+    {
+        std::vector<Frame> frames(depth);
+        std::vector<StateInfo> states(depth);
+        int ply = 0;
+        bool enter = true;
+        
+        while (true) {
+            Frame& f = frames[ply];
+            const int d = depth - ply;
+            
+            if (enter) {
+                enter = false;
+                f.nodes = 0;
+                f.cur = f.end = f.moves;
+                f.hit = false;
+                
+                if (d >= 2 && Perft::TT.enabled()) {
+                    Perft::TT.prefetch(pos.key());
+                    co_await std::suspend_always();
+                    
+                    ++probes;
+                    hits += f.hit = Perft::TT.probe(pos.key(), d, f.nodes);
+                }
+                
+                if (!f.hit) {
+                    f.end = generate<LEGAL>(pos, f.moves);
+                    
+                    if (d == 1) // Bulk count the last ply
+                        f.nodes = f.end - f.moves, f.cur = f.end;
+                }
+            }
+            
+            if (f.cur < f.end) {
+                pos.do_move(*f.cur++, states[ply++]);
+                enter = true;
+                continue;
+            }
+            
+            if (d >= 2 && !f.hit && Perft::TT.enabled())
+                Perft::TT.store(pos.key(), d, f.nodes);
+            
+            if (ply == 0)
+                break;
+            
+            --ply;
+            pos.undo_move(*(frames[ply].cur - 1));
+            frames[ply].nodes += f.nodes;
+        }
+        
+        result = frames[0].nodes;
+    }
+    
+} // namespace
+
+
+/// Perft::interleaved_perft() counts the same leaves as perft() on a single
+/// thread, but runs several subtree walks at once, switching to the next walk
+/// whenever one waits for a table entry. The tree is split at splitDepth plies
+/// and each walk gets its own Position, set up from the root FEN and the moves.
+
+uint64_t Perft::interleaved_perft(Position& pos, int depth, int walkers, int splitDepth)
+{
+    if (depth <= 0)
+        return 1;
+    
+    splitDepth = std::max(0, std::min({ splitDepth, depth - 1, MaxSplitDepth }));
+    walkers = std::max(walkers, 1);
+    
+    vector<Task> tasks;
+    Task task = {};
+    split(pos, 0, splitDepth, task, tasks);
+    
+    struct Slot {
+        Position pos;
+        StateInfo states[MaxSplitDepth + 1];
+        Walk walk;
+        uint64_t nodes;
+    };
+    
+    const string fen = pos.fen();
+    unique_ptr<Slot[]> slots(new Slot[walkers]);
+    uint64_t nodes = 0, probes = 0, hits = 0;
+    size_t next = 0;
+    int active = 0;
+    
+    auto start = [&](Slot& s) {
+        const Task& t = tasks[next++];
+        s.pos.set(fen, &s.states[0]);
+        
+        for (int ply = 0; ply < splitDepth; ++ply)
+            s.pos.do_move(t.moves[ply], s.states[ply + 1]);
+        
+        s.walk = walk(s.pos, depth - splitDepth, s.nodes, probes, hits);
+        ++active;
+    };
+    
+    for (int i = 0; i < walkers && next < tasks.size(); ++i)
+        start(slots[i]);
+    
+    // Round robin over the walks, each one runs until its next probe
+    while (active)
+        for (int i = 0; i < walkers; ++i) {
+            Slot& s = slots[i];
+            
+            if (!s.walk)
+                continue;
+            
+            s.walk.resume();
+            
+            if (s.walk.done()) {
+                nodes += s.nodes;
+                s.walk = Walk();
+                --active;
+                
+                if (next < tasks.size())
+                    start(s);
+            }
+        }
+    
+    TT.probes += probes;
+    TT.hits += hits;
+    
+    return nodes;
+}
+
+#else
+
+uint64_t Perft::interleaved_perft(Position& pos, int depth, int, int)
+{
+    return perft(pos, depth);
+}
+
+#endif
+
+
+/// Perft::divide() runs perft under each root move and prints the node count
+/// of every root move, in move generation order, then the total, the elapsed
+/// time and the speed.
+
+uint64_t Perft::divide(Position& pos, int depth, ostream& os, int threads, int splitDepth)
+{
+    TT.probes = TT.hits = 0;
+    
+    auto start = chrono::steady_clock::now();
+    
+    const MoveList<LEGAL> rootMoves(pos);
+    vector<uint64_t> counts = root_counts(pos, depth, threads, splitDepth);
+    uint64_t nodes = 0;
+    
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    
+    for (size_t i = 0; i < rootMoves.size(); ++i) {
+        nodes += counts[i];
+        os << UCI::move(rootMoves.begin()[i]) << ": " << counts[i] << "\n";
+    }
+    
+    os << "\nNodes searched: " << nodes
+       << "\nTime (ms)     : " << uint64_t(elapsed * 1000)
+       << "\nNodes/second  : " << uint64_t(nodes / max(elapsed, 1e-9)) << endl;
+    
+    if (TT.enabled())
+        os << "Hash hits     : " << TT.hits << " / " << TT.probes << " probes ("
+           << 100.0 * TT.hits / max(uint64_t(TT.probes), uint64_t(1)) << "%)" << endl;
+    
+    return nodes;
+}
@@ -0,0 +1,72 @@
+#ifndef PERFT_H_INCLUDED
+#define PERFT_H_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <memory> // For std::unique_ptr
+
+#include "types.h"
+
+class Position;
+
+/// The interleaved perft walker needs C++20 coroutines. Without them it falls
+/// back to the plain recursive walker.
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#  define USE_COROUTINES
+#endif
+
+
+/// PerftTable stores the leaf counts of the subtrees already counted, keyed by
+/// the position key and the remaining depth. It is shared by the perft threads
+/// without locks: an entry holds the key xor-ed with its data, so an entry torn
+/// by two threads writing at the same time fails the key test and is ignored.
+
+class PerftTable {
+    
+    struct Entry {
+        std::atomic<uint64_t> keyXorData;
+        std::atomic<uint64_t> data; // Leaf count in the upper 56 bits, depth in the lower 8
+    };
+    
+public:
+    void resize(size_t mbSize);
+    void clear();
+    bool enabled() const { return entryCount; }
+    size_t size_mb() const { return mbSize; }
+    bool probe(Key key, int depth, uint64_t& nodes) const;
+    void prefetch(Key key) const;
+    void store(Key key, int depth, uint64_t nodes);
+    
+    std::atomic<uint64_t> probes{0}, hits{0};
+    
+private:
+    Entry& entry(Key key) const { return table[key & (entryCount - 1)]; }
+    
+    std::unique_ptr<Entry[]> table;
+    size_t entryCount = 0;
+    size_t mbSize = 0;
+};
+
+
+namespace Perft {
+    
+    /// Number of plies the tree is split at into the tasks of a parallel perft
+    constexpr int DefaultSplitDepth = 2;
+    constexpr int MaxSplitDepth = 4;
+    
+    /// Number of subtree walks interleaved on one thread by interleaved_perft()
+    constexpr int DefaultWalkers = 8;
+    
+    extern PerftTable TT;
+    
+    uint64_t perft(Position& pos, int depth);
+    uint64_t perft(Position& pos, int depth, int threads, int splitDepth = DefaultSplitDepth);
+    uint64_t interleaved_perft(Position& pos, int depth, int walkers = DefaultWalkers,
+                               int splitDepth = DefaultSplitDepth);
+    uint64_t divide(Position& pos, int depth, std::ostream& os,
+                    int threads = 1, int splitDepth = DefaultSplitDepth);
+    
+} // namespace Perft
+
+#endif // #ifndef PERFT_H_INCLUDED
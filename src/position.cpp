@@ -7,6 +7,9 @@
 #include "position.h"
 #include "board.h"
 #include "log.h"
+#include "misc.h"
+#include "movegen.h"
+#include "uci.h"
 
 using std::string;
 
@@ -14,6 +17,77 @@ using std::string;
 namespace {
 
     const string PieceToChar(" PNBRQK  pnbrqk");
+    
+    // min_attacker() is a helper function used by see_ge() to locate the least
+    // valuable attacker for the side to move, remove the attacker we just found
+    // from the bitboards and scan for new X-ray attacks behind it.
+    
+    template<int Pt>
+    PieceType min_attacker(const Bitboard* bb, Square_int to, Bitboard stmAttackers,
+                           Bitboard& occupied, Bitboard& attackers)
+    {
+        Bitboard b = stmAttackers & bb[Pt];
+        if (!b)
+            return min_attacker<Pt + 1>(bb, to, stmAttackers, occupied, attackers);
+        
+        occupied ^= b & ~(b - 1);
+        
+        if (Pt == PAWN || Pt == BISHOP || Pt == QUEEN)
+            attackers |= attacks_bb<BISHOP>(to, occupied) & (bb[BISHOP] | bb[QUEEN]);
+        
+        if (Pt == ROOK || Pt == QUEEN)
+            attackers |= attacks_bb<ROOK>(to, occupied) & (bb[ROOK] | bb[QUEEN]);
+        
+        attackers &= occupied; // After X-ray that may add already processed pieces
+        return PieceType(Pt);
+    }
+    
+    template<>
+    PieceType min_attacker<KING>(const Bitboard*, Square_int, Bitboard, Bitboard&, Bitboard&)
+    {
+        return KING; // No need to update bitboards: it is the last cycle
+    }
+    
+    struct ZobristKeys {
+        Key psq[PIECE_NB][SQUARE_NB];
+        Key enpassant[FILE_NB];
+        Key castling[CASTLING_RIGHT_NB];
+        Key side;
+    };
+    
+    /// init_zobrist() generates the Zobrist keys from a fixed seed. The key of
+    /// a combination of castling rights is the XOR of the keys of its single
+    /// rights, so that removing one right is a single XOR.
+    
+    constexpr ZobristKeys init_zobrist()
+    {
+        ZobristKeys z{};
+        PRNG rng(1070372);
+        
+        for (int pc = 0; pc < PIECE_NB; ++pc)
+            for (int s = 0; s < SQUARE_NB; ++s)
+                z.psq[pc][s] = rng.rand<Key>();
+        
+        for (int f = FILE_A; f <= FILE_H; ++f)
+            z.enpassant[f] = rng.rand<Key>();
+        
+        for (int cr = NO_CASTLING; cr <= ANY_CASTLING; ++cr)
+            for (int b = 0; b < 4; ++b)
+                if (cr & (1 << b)) {
+                    Key k = z.castling[1 << b];
+                    z.castling[cr] ^= k ? k : rng.rand<Key>();
+                }
+        
+        z.side = rng.rand<Key>();
+        
+        return z;
+    }
+    
+    constexpr ZobristKeys Zobrist = init_zobrist();
+    
+    static_assert(Zobrist.side && Zobrist.castling[ANY_CASTLING] == (Zobrist.castling[WHITE_OO] ^ Zobrist.castling[WHITE_OOO]
+                                                                   ^ Zobrist.castling[BLACK_OO] ^ Zobrist.castling[BLACK_OOO]),
+                  "Zobrist keys are not compile-time constants");
 
 } // namespace
 
@@ -59,7 +133,8 @@ Position& Position::set(const string& fenStr, StateInfo* si)
       incremented after Black's move.
 */
     
-    unsigned char col = FILE_A, row = RANK_8, token;  // col = 0, row = 7
+    unsigned char col, row, token;
+    Square_int sq = SQ_A8;
     size_t idx;
     std::istringstream ss(fenStr);
     
@@ -73,16 +148,14 @@ Position& Position::set(const string& fenStr, StateInfo* si)
     // 1. Piece placement
     while ((ss >> token) && !isspace(token)) {
         if (isdigit(token))
-            col += token - '0'; // Advance the given number of files
+            sq += Direction(token - '0'); // Advance the given number of files
         
-        else if (token == '/') {
-            row -= 1;
-            col = FILE_A;  // = 0
-        }
+        else if (token == '/')
+            sq += Direction(2 * SOUTH);
         
         else if ((idx = PieceToChar.find(token)) != string::npos) {
-            put_piece(Piece(idx), col, row);
-            ++col;
+            put_piece(Piece(idx), sq);
+            ++sq;
         }
     }
     
@@ -123,6 +196,9 @@ Position& Position::set(const string& fenStr, StateInfo* si)
         && ((ss >> row) && (row == '3' || row == '6'))) {
         
         st->epSquare = make_square(File(col - 'a'), Rank(row - '1'));
+        
+        if (!(pawn_attacks_from(~sideToMove, st->epSquare) & pieces(sideToMove, PAWN)))
+            st->epSquare = SQ_NONE;
     }
     else
         st->epSquare = SQ_NONE;
@@ -135,8 +211,9 @@ Position& Position::set(const string& fenStr, StateInfo* si)
     gamePly = std::max(2 * (gamePly - 1), 0) + (sideToMove == BLACK);
     
     set_state(st);
+    update_squares_attackers_count<true>(pieces());
     
-    //assert(pos_is_ok());  TODO
+    assert(pos_is_ok());
     
     return *this;
 }
@@ -145,9 +222,9 @@ void Position::print_position() const
 {
     LOG::log("Position:");
     std::ostringstream ss;
-    for (int row = RANK_8; row >= RANK_1; --row) {
-        for (int col = FILE_A; col <= FILE_H; ++col) {
-            ss << PieceToChar[ board[col][row] ] << "\t";
+    for (Rank r = RANK_8; r >= RANK_1; --r) {
+        for (File f = FILE_A; f <= FILE_H; ++f) {
+            ss << PieceToChar[ board[make_square(f, r)] ] << "\t";
         }
         LOG::log(ss.str());
         ss.str("");
@@ -155,6 +232,53 @@ void Position::print_position() const
 }
 
 
+/// Position::fen() returns a FEN representation of the position
+
+const string Position::fen() const
+{
+    int emptyCnt;
+    std::ostringstream ss;
+    
+    for (Rank r = RANK_8; r >= RANK_1; --r) {
+        for (File f = FILE_A; f <= FILE_H; ++f) {
+            for (emptyCnt = 0; f <= FILE_H && piece_on(make_square(f, r)) == NO_PIECE; ++f)
+                ++emptyCnt;
+            
+            if (emptyCnt)
+                ss << emptyCnt;
+            
+            if (f <= FILE_H)
+                ss << PieceToChar[piece_on(make_square(f, r))];
+        }
+        
+        if (r > RANK_1)
+            ss << '/';
+    }
+    
+    ss << (sideToMove == WHITE ? " w " : " b ");
+    
+    if (can_castle(WHITE_OO))
+        ss << 'K';
+    
+    if (can_castle(WHITE_OOO))
+        ss << 'Q';
+    
+    if (can_castle(BLACK_OO))
+        ss << 'k';
+    
+    if (can_castle(BLACK_OOO))
+        ss << 'q';
+    
+    if (!can_castle(WHITE) && !can_castle(BLACK))
+        ss << '-';
+    
+    ss << ' ' << (ep_square() == SQ_NONE ? string("-") : UCI::square(ep_square())) << ' '
+       << st->rule50 << " " << 1 + (gamePly - (sideToMove == BLACK)) / 2;
+    
+    return ss.str();
+}
+
+
 /// Position::set_castling_right() is a helper function used to set castling
 /// rights given the corresponding color and the rook starting square.
 
@@ -186,69 +310,98 @@ void Position::set_castling_right(Color c, Square_int rfrom)
 
 void Position::set_check_info(StateInfo* si) const
 {
-    for (int file = FILE_A; file <= FILE_H; ++file)
-        for (int rank = RANK_1; rank <= RANK_8; ++rank) {
-            Piece pc = piece_on(file, rank);
-            PieceType pt = type_of(pc);
-            
-            if (pt == BISHOP || pt == ROOK || pt == QUEEN) {
-                Color c = color_of(pc);
-                VectorSquareList sqList = slider_blockers(Square(file, rank), square<KING>(~c));
-                if (sqList.size() == 1)
-                    si->blockersForKing[~c].addSquare( sqList.front() );
-            }
-        }
+    si->blockersForKing[WHITE] = slider_blockers(pieces(BLACK), square<KING>(WHITE), si->pinners[BLACK]);
+    si->blockersForKing[BLACK] = slider_blockers(pieces(WHITE), square<KING>(BLACK), si->pinners[WHITE]);
+    
+    set_check_squares(si);
 }
 
 
+/// Position::set_check_squares() sets the squares from where each piece type of
+/// the side to move would give check to the enemy king
+
+void Position::set_check_squares(StateInfo* si) const
+{
+    Square_int ksq = square<KING>(~sideToMove);
+    
+    si->checkSquares[PAWN]   = pawn_attacks_from(~sideToMove, ksq);
+    si->checkSquares[KNIGHT] = knight_attacks_from(ksq);
+    si->checkSquares[BISHOP] = bishop_attacks_from(*this, ksq);
+    si->checkSquares[ROOK]   = rook_attacks_from(*this, ksq);
+    si->checkSquares[QUEEN]  = si->checkSquares[BISHOP] | si->checkSquares[ROOK];
+    si->checkSquares[KING]   = 0;
+}
+
+
+/// Position::set_state() computes the hash key, the checkers and the check info
+/// of a newly set up position. do_move() updates the same fields for each move.
+
 void Position::set_state(StateInfo* si) const
 {
+    si->key = 0;
+    
+    for (Bitboard b = pieces(); b; ) {
+        Square_int s = pop_lsb(&b);
+        si->key ^= Zobrist.psq[piece_on(s)][s];
+    }
+    
+    if (si->epSquare != SQ_NONE)
+        si->key ^= Zobrist.enpassant[file_of(si->epSquare)];
+    
+    if (sideToMove == BLACK)
+        si->key ^= Zobrist.side;
+    
+    si->key ^= Zobrist.castling[si->castlingRights];
+    
+    si->checkersBB = attackers_to(square<KING>(sideToMove)) & pieces(~sideToMove);
+    si->attackedKingSquares = squares_behind_king(si->checkersBB);
+    
     set_check_info(si);
 }
 
 
-VectorSquareList Position::slider_blockers(Square from, Square to) const
+/// Position::attackers_to() computes a bitboard of all pieces which attack a
+/// given square. Slider attacks use the occupied bitboard to indicate occupancy.
+
+Bitboard Position::attackers_to(Square_int s, Bitboard occupied) const
 {
-    Piece pc = piece_on(from);
-    PieceType pt = type_of(pc);
-    assert(pt == BISHOP || pt == ROOK || pt == QUEEN);
-    assert(from != to);
+    return  (pawn_attacks_from(BLACK, s)       & pieces(WHITE, PAWN))
+          | (pawn_attacks_from(WHITE, s)       & pieces(BLACK, PAWN))
+          | (knight_attacks_from(s)            & pieces(KNIGHT))
+          | (attacks_bb<  ROOK>(s, occupied)   & pieces(  ROOK, QUEEN))
+          | (attacks_bb<BISHOP>(s, occupied)   & pieces(BISHOP, QUEEN))
+          | (king_attacks_from(s)              & pieces(KING));
+}
+
+
+/// Position::slider_blockers() returns a bitboard of all the pieces (both colors)
+/// that are blocking attacks on the square 's' from 'sliders'. A piece blocks a
+/// slider if removing that piece from the board would result in a position where
+/// square 's' is attacked. For example, a king-attack blocking piece can be either
+/// a pinned or a discovered check piece, according if its color is the opposite
+/// or the same of the color of the slider.
+
+Bitboard Position::slider_blockers(Bitboard sliders, Square_int s, Bitboard& pinners) const
+{
+    Bitboard blockers = 0;
+    pinners = 0;
     
-    VectorSquareList blockersList;
+    // Snipers are sliders that attack 's' when a piece is removed
+    Bitboard snipers = (  (PseudoAttacks[  ROOK][s] & pieces(QUEEN, ROOK))
+                        | (PseudoAttacks[BISHOP][s] & pieces(QUEEN, BISHOP))) & sliders;
     
-    if ((from.file == to.file) && (pt == ROOK || pt == QUEEN)) {
-        //assert(abs(to.rank - from.rank) > 1);
-        for (int r = std::min(from.rank, to.rank) + 1; r < std::max(from.rank, to.rank); ++r) {
-            if (piece_on(from.file, r) != NO_PIECE)
-                blockersList.addSquare(Square(from.file, r));
-        }
-        return blockersList;
-    }
-    else if ((from.rank == to.rank) && (pt == ROOK || pt == QUEEN)) {
-        //assert(abs(to.file - from.file) > 1);
-        for (int f = std::min(from.file, to.file) + 1; f < std::max(from.file, to.file); ++f) {
-            if (piece_on(f, from.rank) != NO_PIECE)
-                blockersList.addSquare(Square(f, from.rank));
-        }
-        return blockersList;
-    }
-    else if ((abs(to.file - from.file) == abs(to.rank - from.rank))  &&  (pt == BISHOP || pt == QUEEN)) {
-        //assert(abs(to.file - from.file) > 1);
-        /*for (   int f = std::min(from.file, to.file) + 1, r = std::min(from.rank, to.rank) + 1;
-                    f < std::max(from.file, to.file)  &&  r < std::max(from.rank, to.rank);
-                ++f, ++r    ) {*/       // Unfortunately, this doesn't work like that :)
-        const int df = (from.file < to.file) ? +1 : -1;
-        const int dr = (from.rank < to.rank) ? +1 : -1;
-        for (   int f = from.file + df, r = from.rank + dr;
-                f != to.file && r != to.rank;
-                f += df, r += dr    ) {
-            if (piece_on(f, r) != NO_PIECE)
-                blockersList.addSquare(Square(f, r));
+    while (snipers) {
+        const Square_int sniperSq = pop_lsb(&snipers);
+        const Bitboard b = between_bb(s, sniperSq) & pieces();
+        
+        if (!more_than_one(b)) {
+            blockers |= b;
+            if (b & pieces(color_of(piece_on(s))))
+                pinners |= sniperSq;
         }
-        //return blockersList;
     }
     
-    return blockersList;
+    return blockers;
 }
 
 
@@ -257,24 +410,255 @@ VectorSquareList Position::slider_blockers(Square from, Square to) const
 bool Position::legal(Move m) const
 {
     Color us = sideToMove;
+    Square_int from = from_sq(m);
     
-    // En passant captures
-    if (m.to == st->epSquare) {
-        // TODO
+    // En passant captures are a tricky special case. Because they are rather
+    // uncommon, we do it simply by testing whether the king is attacked after
+    // the move is made.
+    if (type_of(m) == ENPASSANT) {
+        Square_int ksq = square<KING>(us);
+        Square_int to = to_sq(m);
+        Square_int capsq = to - pawn_push(us);
+        Bitboard occupied = (pieces() ^ from ^ capsq) | to;
+        
+        return   !(attacks_bb<  ROOK>(ksq, occupied) & pieces(~us) & pieces(  ROOK, QUEEN))
+              && !(attacks_bb<BISHOP>(ksq, occupied) & pieces(~us) & pieces(BISHOP, QUEEN));
     }
     
+    // If the moving piece is a king, check whether the destination square is
+    // attacked by the opponent, with the king removed so that it cannot hide
+    // behind itself. Castling moves are checked for attacks by the generator.
+    if (type_of(piece_on(from)) == KING)
+        return   type_of(m) == CASTLING
+              || !(attackers_to(to_sq(m), pieces() ^ from) & pieces(~us));
+    
     // A non-king move is legal if and only if it is not pinned or it
     // is moving along the ray towards or away from the king.
-    return !blockers_for_king(us).contains(m.from)
-        || aligned(m.from, m.to, square<KING>(us));
+    return !(blockers_for_king(us) & from)
+        || aligned(from, to_sq(m), square<KING>(us));
+}
+
+
+/// Position::pseudo_legal() takes a random move and tests whether the move is
+/// pseudo legal. It is used to validate moves from the transposition table,
+/// the killer slots or the GUI without generating the whole move list. Castling
+/// moves are fully validated here, the other moves still need a legal() test.
+
+bool Position::pseudo_legal(Move m) const
+{
+    Color us = sideToMove;
+    Square_int from = from_sq(m);
+    Square_int to = to_sq(m);
+    Piece pc = piece_on(from);
+    
+    // The moved piece must be ours. This also rejects MOVE_NONE and MOVE_NULL
+    if (!is_ok(m) || pc == NO_PIECE || color_of(pc) != us)
+        return false;
+    
+    // The promotion bits must be clear unless the move is a promotion
+    if (type_of(m) != PROMOTION && promotion_type(m) != KNIGHT)
+        return false;
+    
+    // Castling is encoded as "king captures friendly rook". The king may not
+    // leave, cross or land on an attacked square.
+    if (type_of(m) == CASTLING) {
+        CastlingRight cr = us | (to > from ? KING_SIDE : QUEEN_SIDE);
+        Square_int kto = relative_square(us, to > from ? SQ_G1 : SQ_C1);
+        
+        return   type_of(pc) == KING
+              && !checkers()
+              && can_castle(cr)
+              && castling_rook_square(cr) == to
+              && !castling_impeded(cr)
+              && !((between_bb(from, kto) | kto) & attacked_by(~us));
+    }
+    
+    // The destination square cannot be occupied by a friendly piece
+    if (pieces(us) & to)
+        return false;
+    
+    if (type_of(pc) == PAWN) {
+        // Promotions are the only pawn moves to the last rank
+        if ((rank_of(to) == relative_rank(us, RANK_8)) != (type_of(m) == PROMOTION))
+            return false;
+        
+        if (type_of(m) == ENPASSANT) {
+            if (to != ep_square() || !(pawn_attacks_from(us, from) & to))
+                return false;
+        }
+        else if (   !(pawn_attacks_from(us, from) & pieces(~us) & to) // Not a capture
+                 && !((from + pawn_push(us) == to) && !(pieces() & to)) // Not a single push
+                 && !(   (from + pawn_push(us) + pawn_push(us) == to) // Not a double push
+                      && (relative_rank(us, rank_of(from)) == RANK_2)
+                      && !(pieces() & to)
+                      && !(pieces() & (to - pawn_push(us)))))
+            return false;
+    }
+    else if (type_of(m) != NORMAL || !(attacks_bb(type_of(pc), from, pieces()) & to))
+        return false;
+    
+    // Evasions generator already takes care to avoid some kind of illegal moves
+    // and legal() relies on this. We therefore have to take care that the same
+    // kind of moves are filtered out here.
+    if (checkers()) {
+        if (type_of(pc) != KING) {
+            // Double check? In this case a king move is required
+            if (more_than_one(checkers()))
+                return false;
+            
+            // Our move must be a blocking evasion or a capture of the checking
+            // piece, the en passant capture of a checking pawn included.
+            Bitboard target = between_bb(lsb(checkers()), square<KING>(us)) | checkers();
+            if (   !(target & to)
+                && !(type_of(m) == ENPASSANT && (checkers() & (to - pawn_push(us)))))
+                return false;
+        }
+        // In case of king moves under check we have to remove king so as to catch
+        // invalid moves like b1a1 when opposite queen is on c1.
+        else if (attackers_to(to, pieces() ^ from) & pieces(~us))
+            return false;
+    }
+    
+    return true;
 }
 
 
 /// Position::gives_check() tests whether a pseudo-legal move gives a check
 
-bool Position::gives_check(Move m) const  // TODO
+bool Position::gives_check(Move m) const
 {
-    return 0;
+    assert(is_ok(m));
+    assert(color_of(piece_on(from_sq(m))) == sideToMove);
+    
+    Square_int from = from_sq(m);
+    Square_int to = to_sq(m);
+    Square_int ksq = square<KING>(~sideToMove);
+    
+    // Is there a direct check?
+    if (st->checkSquares[type_of(piece_on(from))] & to)
+        return true;
+    
+    // Is there a discovered check?
+    if (   (st->blockersForKing[~sideToMove] & pieces(sideToMove) & from)
+        && !aligned(from, to, ksq))
+        return true;
+    
+    switch (type_of(m)) {
+    case NORMAL:
+        return false;
+    
+    case PROMOTION:
+        return attacks_bb(promotion_type(m), to, pieces() ^ from) & ksq;
+    
+    // En passant capture with check? We have already handled the case of direct
+    // checks and ordinary discovered check, so the only case we need to handle
+    // is the unusual case of a discovered check through the captured pawn.
+    case ENPASSANT: {
+        Square_int capsq = make_square(file_of(to), rank_of(from));
+        Bitboard b = (pieces() ^ from ^ capsq) | to;
+        
+        return   (attacks_bb<  ROOK>(ksq, b) & pieces(sideToMove) & pieces(  ROOK, QUEEN))
+              || (attacks_bb<BISHOP>(ksq, b) & pieces(sideToMove) & pieces(BISHOP, QUEEN));
+    }
+    
+    case CASTLING: {
+        Square_int kfrom = from;
+        Square_int rfrom = to; // Castling is encoded as "king captures friendly rook"
+        Square_int kto = relative_square(sideToMove, rfrom > kfrom ? SQ_G1 : SQ_C1);
+        Square_int rto = relative_square(sideToMove, rfrom > kfrom ? SQ_F1 : SQ_D1);
+        
+        return   (PseudoAttacks[ROOK][rto] & ksq)
+              && (attacks_bb<ROOK>(rto, (pieces() ^ kfrom ^ rfrom) | rto | kto) & ksq);
+    }
+    
+    default:
+        assert(false);
+        return false;
+    }
+}
+
+
+/// Position::see_ge() tests if the SEE (Static Exchange Evaluation) value of a
+/// move is greater than or equal to the given threshold. The exchange on the
+/// destination square is resolved with the least valuable attacker first,
+/// including the X-ray attackers uncovered behind each capturing piece.
+
+bool Position::see_ge(Move m, Value threshold) const
+{
+    assert(is_ok(m));
+    
+    // Only deal with normal moves, assume others pass a simple see
+    if (type_of(m) != NORMAL)
+        return VALUE_ZERO >= threshold;
+    
+    Square_int from = from_sq(m), to = to_sq(m);
+    PieceType nextVictim = type_of(piece_on(from));
+    Color us = color_of(piece_on(from));
+    Color stm = ~us; // First consider opponent's move
+    Value balance;   // Values of the pieces taken by us minus opponent's ones
+    Bitboard stmAttackers;
+    
+    // The opponent may be able to recapture so this is the best result
+    // we can hope for.
+    balance = PieceValue[piece_on(to)] - threshold;
+    
+    if (balance < VALUE_ZERO)
+        return false;
+    
+    // Now assume the worst possible result: that the opponent can
+    // capture our piece for free.
+    balance -= PieceValue[nextVictim];
+    
+    // If it is enough (like in PxQ) then return immediately. Note that
+    // in case nextVictim == KING we always return here, this is ok
+    // if the given move is legal.
+    if (balance >= VALUE_ZERO)
+        return true;
+    
+    // Find all attackers to the destination square, with the moving piece
+    // removed, but possibly an X-ray attacker added behind it.
+    Bitboard occupied = pieces() ^ from ^ to;
+    Bitboard attackers = attackers_to(to, occupied) & occupied;
+    
+    while (true) {
+        stmAttackers = attackers & pieces(stm);
+        
+        // Don't allow pinned pieces to attack (except the king) as long as
+        // all pinners are on their original square.
+        if (!(st->pinners[~stm] & ~occupied))
+            stmAttackers &= ~st->blockersForKing[stm];
+        
+        // If stm has no more attackers then give up: stm loses
+        if (!stmAttackers)
+            break;
+        
+        // Locate and remove the next least valuable attacker, and add to
+        // the bitboard 'attackers' the possibly X-ray attackers behind it.
+        nextVictim = min_attacker<PAWN>(byTypeBB, to, stmAttackers, occupied, attackers);
+        
+        stm = ~stm; // Switch side to move
+        
+        // Negamax the balance with alpha = balance, beta = balance+1 and
+        // add nextVictim's value.
+        //
+        //      (balance, balance+1) -> (-balance-1, -balance)
+        //
+        assert(balance < VALUE_ZERO);
+        
+        balance = -balance - 1 - PieceValue[nextVictim];
+        
+        // If balance is still non-negative after giving away nextVictim then we
+        // win. The only thing to be careful about it is that we should revert
+        // stm if we captured with the king when the opponent still has attackers.
+        if (balance >= VALUE_ZERO) {
+            if (nextVictim == KING && (attackers & pieces(stm)))
+                stm = ~stm;
+            break;
+        }
+        assert(nextVictim != KING);
+    }
+    
+    return us != stm; // We break the above loop when stm loses
 }
 
 
@@ -293,6 +677,10 @@ void Position::do_move(Move m, StateInfo& newSt, bool givesCheck)
     newSt.previous = st;
     st = &newSt;
     
+    // Update the hash key for the side to move right away, the rest is added
+    // piece by piece below.
+    Key k = st->previous->key ^ Zobrist.side;
+    
     // Increment ply counters. In particular, rule50 will be reset to zero later on
     // in case of a capture or a pawn move.
     ++gamePly;
@@ -301,55 +689,83 @@ void Position::do_move(Move m, StateInfo& newSt, bool givesCheck)
     
     Color us = sideToMove;
     Color them = ~us;
-    Piece pc = piece_on(m.from);
-    bool m_en_passant = m.to == st->epSquare;  // type_of(m.flags) == ENPASSANT
-    Piece captured = m_en_passant ? make_piece(them, PAWN) : piece_on(m.to);
+    Square_int from = from_sq(m);
+    Square_int to = to_sq(m);
+    Piece pc = piece_on(from);
+    Piece captured = type_of(m) == ENPASSANT ? make_piece(them, PAWN) : piece_on(to);
+    
+    // Remove the attacks of the pieces on the squares changing occupancy, they
+    // are added back once the move is made. The sliders whose lines go through
+    // those squares are updated afterwards by the difference of their attacks.
+    const Bitboard changed = move_squares(us, m);
+    const Bitboard sliders = sliders_through(changed) & ~changed;
+    const Bitboard occupied = pieces();
     
-    if (type_of(m.flags) == CASTLING) {
-        do_castling<true>(us, m.from, m.to);
+    update_squares_attackers_count<false>(pieces() & changed);
+    
+    if (type_of(m) == CASTLING) {
+        Square_int rfrom, rto;
+        do_castling<true>(us, from, to, rfrom, rto);
+        
+        k ^= Zobrist.psq[make_piece(us, ROOK)][rfrom] ^ Zobrist.psq[make_piece(us, ROOK)][rto];
         captured = NO_PIECE;
     }
     
     if (captured) {
-        Square capsq = m.to;
+        Square_int capsq = to;
         
         if (type_of(captured) == PAWN) {
-            if (m_en_passant) {
-                capsq = capsq - pawn_push(us);
-                board[capsq.file][capsq.rank] = NO_PIECE; // Not done by remove_piece()
+            if (type_of(m) == ENPASSANT) {
+                capsq -= pawn_push(us);
+                board[capsq] = NO_PIECE; // Not done by remove_piece()
             }
         }
         
         // Update board and piece lists
         remove_piece(captured, capsq);
         
+        // Update hash key
+        k ^= Zobrist.psq[captured][capsq];
+        
         // Reset rule 50 counter
         st->rule50 = 0;
     }
     
+    // Update hash key
+    k ^= Zobrist.psq[pc][from] ^ Zobrist.psq[pc][to];
+    
     // Reset en passant square
-    //if (st->epSquare != SQ_NONE)
+    if (st->epSquare != SQ_NONE) {
+        k ^= Zobrist.enpassant[file_of(st->epSquare)];
         st->epSquare = SQ_NONE;
+    }
     
     // Update castling rights if needed
-    if (st->castlingRights && (castlingRightsMask[m.from] | castlingRightsMask[m.to])) {
-        int cr = castlingRightsMask[m.from] | castlingRightsMask[m.to];
+    if (st->castlingRights && (castlingRightsMask[from] | castlingRightsMask[to])) {
+        int cr = castlingRightsMask[from] | castlingRightsMask[to];
+        k ^= Zobrist.castling[st->castlingRights & cr];
         st->castlingRights &= ~cr;
     }
     
     // Move the piece. The tricky Chess960 castling is handled earlier
-    if (type_of(m.flags) != CASTLING)
-        move_piece(m.from, m.to);
+    if (type_of(m) != CASTLING)
+        move_piece(from, to);
     
     // If the moving piece is a pawn do some special extra work
     if (type_of(pc) == PAWN) {
-        // Set en-passant square
-        if ( (int(m.to) ^ int(m.from)) == 16 )
-            st->epSquare = m.to - pawn_push(us);
-        else if (type_of(m.flags) == PROMOTION) {
-            Piece promotion = make_piece(us, promotion_type(m.flags));
-            remove_piece(pc, m.to);
-            put_piece(promotion, m.to.file, m.to.rank);
+        // Set en-passant square if the moved pawn can be captured
+        if (   (int(to) ^ int(from)) == 16
+            && (pawn_attacks_from(us, to - pawn_push(us)) & pieces(them, PAWN))) {
+            st->epSquare = to - pawn_push(us);
+            k ^= Zobrist.enpassant[file_of(st->epSquare)];
+        }
+        else if (type_of(m) == PROMOTION) {
+            Piece promotion = make_piece(us, promotion_type(m));
+            remove_piece(pc, to);
+            put_piece(promotion, to);
+            
+            // Update hash key
+            k ^= Zobrist.psq[pc][to] ^ Zobrist.psq[promotion][to];
         }
         
         // Reset rule 50 draw counter
@@ -359,63 +775,268 @@ void Position::do_move(Move m, StateInfo& newSt, bool givesCheck)
     // Set capture piece
     st->capturedPiece = captured;
     
+    // Update the key with the final value
+    st->key = k;
+    
+    update_squares_attackers_count<true>(pieces() & changed);
+    update_sliders_attackers_count(sliders, occupied);
+    
+    // Calculate checkers bitboard (if move gives check)
+    st->checkersBB = givesCheck ? attackers_to(square<KING>(them)) & pieces(us) : 0;
+    
     sideToMove = ~sideToMove;
     
+    st->attackedKingSquares = givesCheck ? squares_behind_king(st->checkersBB) : 0;
+    
     // Update king attacks used for fast check detection
     set_check_info(st);
+    
+    assert(pos_is_ok());
+}
+
+
+/// Position::undo_move() unmakes a move. When it returns, the position should
+/// be restored to exactly the same state as before the move was made.
+
+void Position::undo_move(Move m)
+{
+    assert(is_ok(m));
+    
+    sideToMove = ~sideToMove;
+    
+    Color us = sideToMove;
+    Square_int from = from_sq(m);
+    Square_int to = to_sq(m);
+    Piece pc = piece_on(to);
+    
+    assert(piece_on(from) == NO_PIECE || type_of(m) == CASTLING);
+    assert(type_of(st->capturedPiece) != KING);
+    
+    const Bitboard changed = move_squares(us, m);
+    const Bitboard sliders = sliders_through(changed) & ~changed;
+    const Bitboard occupied = pieces();
+    
+    update_squares_attackers_count<false>(pieces() & changed);
+    
+    if (type_of(m) == PROMOTION) {
+        assert(relative_rank(us, rank_of(to)) == RANK_8);
+        assert(type_of(pc) == promotion_type(m));
+        
+        remove_piece(pc, to);
+        pc = make_piece(us, PAWN);
+        put_piece(pc, to);
+    }
+    
+    if (type_of(m) == CASTLING) {
+        Square_int rfrom, rto;
+        do_castling<false>(us, from, to, rfrom, rto);
+    }
+    else {
+        move_piece(to, from); // Put the piece back at the source square
+        
+        if (st->capturedPiece) {
+            Square_int capsq = to;
+            
+            if (type_of(m) == ENPASSANT) {
+                capsq -= pawn_push(us);
+                
+                assert(type_of(pc) == PAWN);
+                assert(to == st->previous->epSquare);
+                assert(piece_on(capsq) == NO_PIECE);
+                assert(st->capturedPiece == make_piece(~us, PAWN));
+            }
+            
+            put_piece(st->capturedPiece, capsq); // Restore the captured piece
+        }
+    }
+    
+    update_squares_attackers_count<true>(pieces() & changed);
+    update_sliders_attackers_count(sliders, occupied);
+    
+    // Finally point our state pointer back to the previous state
+    st = st->previous;
+    --gamePly;
+    
+    assert(pos_is_ok());
+}
+
+
+/// Position::do_null_move() is used to do a "null move": it flips the side to
+/// move without touching the board. The pieces, the attack map and the pins
+/// stay the same, only the en passant square, the key and the check squares
+/// need an update, so it is much cheaper than a normal move.
+
+void Position::do_null_move(StateInfo& newSt)
+{
+    assert(!checkers());
+    assert(&newSt != st);
+    
+    std::memcpy(&newSt, st, sizeof(StateInfo));
+    newSt.previous = st;
+    st = &newSt;
+    
+    if (st->epSquare != SQ_NONE) {
+        st->key ^= Zobrist.enpassant[file_of(st->epSquare)];
+        st->epSquare = SQ_NONE;
+    }
+    
+    st->key ^= Zobrist.side;
+    st->capturedPiece = NO_PIECE;
+    
+    ++st->rule50;
+    st->pliesFromNull = 0;
+    
+    sideToMove = ~sideToMove;
+    
+    set_check_squares(st);
+    
+    assert(pos_is_ok());
+}
+
+
+/// Position::undo_null_move() must be used to undo a "null move"
+
+void Position::undo_null_move()
+{
+    assert(!checkers());
+    
+    st = st->previous;
+    sideToMove = ~sideToMove;
+}
+
+
+/// Position::is_draw() tests whether the position is drawn by 50-move rule
+/// or by repetition. It does not detect stalemates. The key chain is walked
+/// back through the previous states, so the game history kept by the UCI
+/// "position" command is searched as well as the moves made in the search.
+
+bool Position::is_draw(int ply) const
+{
+    if (st->rule50 > 99 && (!checkers() || MoveList<LEGAL>(*this).size()))
+        return true;
+    
+    // Neither a capture, a pawn move nor a null move can be crossed, and only
+    // positions with the same side to move can repeat.
+    int end = std::min(st->rule50, st->pliesFromNull);
+    
+    if (end < 4)
+        return false;
+    
+    StateInfo* stp = st->previous->previous;
+    int cnt = 0;
+    
+    for (int i = 4; i <= end; i += 2) {
+        stp = stp->previous->previous;
+        
+        // Return a draw score if a position repeats once earlier but strictly
+        // after the root, or repeats twice before or at the root.
+        if (stp->key == st->key && ++cnt + (ply > i) == 2)
+            return true;
+    }
+    
+    return false;
 }
 
 
 /// Position::do_castling() is a helper used to do/undo a castling move. This
 /// is a bit tricky in Chess960 where from/to squares can overlap.
 template<bool Do>
-void Position::do_castling(Color us, Square from, Square& to/*, Square& rfrom, Square& rto*/)
+void Position::do_castling(Color us, Square_int from, Square_int& to, Square_int& rfrom, Square_int& rto)
 {
     bool kingSide = to > from;
-    Square rfrom = to; // Castling is encoded as "king captures friendly rook"
-    Square rto = relative_square(us, kingSide ? SQ_F1 : SQ_D1);
+    rfrom = to; // Castling is encoded as "king captures friendly rook"
+    rto = relative_square(us, kingSide ? SQ_F1 : SQ_D1);
     to = relative_square(us, kingSide ? SQ_G1 : SQ_C1);
 
     // Remove both pieces first since squares could overlap in Chess960
     remove_piece(make_piece(us, KING), Do ? from : to);
     remove_piece(make_piece(us, ROOK), Do ? rfrom : rto);
-    board[Do ? from.file : to.file][Do ? from.rank : to.rank] =
-        board[Do ? rfrom.file : rto.file][Do ? rfrom.rank : rto.rank] = NO_PIECE; // Since remove_piece doesn't do it for us
+    board[Do ? from : to] = board[Do ? rfrom : rto] = NO_PIECE; // Since remove_piece doesn't do it for us
     put_piece(make_piece(us, KING), Do ? to : from);
     put_piece(make_piece(us, ROOK), Do ? rto : rfrom);
 }
 
-void Position::update()
+/// Position::move_squares() returns the squares whose occupancy is changed by
+/// a move of the given side: the destination of an en passant capture and the
+/// king and rook squares of a castling included.
+
+Bitboard Position::move_squares(Color us, Move m) const
 {
-    update_squares_attackers_count();
-    update_attacked_king_squares();
+    const Square_int from = from_sq(m);
+    const Square_int to = to_sq(m);
+    
+    if (type_of(m) == ENPASSANT)
+        return SquareBB[from] | to | (to - pawn_push(us));
+    
+    if (type_of(m) == CASTLING) {
+        const bool kingSide = to > from;
+        return   SquareBB[from] | to
+               | relative_square(us, kingSide ? SQ_G1 : SQ_C1)
+               | relative_square(us, kingSide ? SQ_F1 : SQ_D1);
+    }
+    
+    return SquareBB[from] | to;
 }
 
-void Position::update_squares_attackers_count()
+
+/// Position::sliders_through() returns the sliders of both colors attacking any
+/// of the given squares, whose attacks change when those squares are emptied
+/// or filled.
+
+Bitboard Position::sliders_through(Bitboard squares) const
 {
-    Square ksq = square<KING>(sideToMove);
-    for (int f = 0; f < 8; ++f)
-        for (int r = 0; r < 8; ++r) {
-            const Piece pc = board[f][r];
-            if (pc != NO_PIECE) {
-                const SquareList list = figure_attacks_from(type_of(pc), *this, f, r);
-                for (const auto& sq : list) {
-                    ++squares_attackers_count[color_of(pc)][sq.file][sq.rank];
-                    if ((color_of(pc) != sideToMove) && (sq == ksq))
-                        st->checkers.addSquare(Square(f, r));
-                }
-            }
-        }
+    Bitboard sliders = 0;
+    
+    while (squares) {
+        const Square_int s = pop_lsb(&squares);
+        sliders |=  (attacks_bb<BISHOP>(s, pieces()) & pieces(BISHOP, QUEEN))
+                  | (attacks_bb<  ROOK>(s, pieces()) & pieces(  ROOK, QUEEN));
+    }
+    
+    return sliders;
+}
+
+
+/// Position::update_squares_attackers_count() adds or removes the attacks of the
+/// given pieces to or from the attack counts. The pawns of each color are done
+/// set-wise: a square attacked by two pawns is in both the single and the double
+/// attack bitboards, so it is counted twice.
+
+template<bool Add>
+void Position::update_squares_attackers_count(Bitboard pcs)
+{
+    auto update = [this](Color c, Bitboard b) {
+        if (Add)
+            inc_squares_attackers_count(c, b);
+        else
+            dec_squares_attackers_count(c, b);
+    };
+    
+    const Bitboard whitePawns = pcs & pieces(WHITE, PAWN);
+    const Bitboard blackPawns = pcs & pieces(BLACK, PAWN);
+    
+    update(WHITE, pawn_attacks_bb<WHITE>(whitePawns));
+    update(WHITE, pawn_double_attacks_bb<WHITE>(whitePawns));
+    update(BLACK, pawn_attacks_bb<BLACK>(blackPawns));
+    update(BLACK, pawn_double_attacks_bb<BLACK>(blackPawns));
+    
+    pcs &= ~pieces(PAWN);
+    
+    while (pcs) {
+        const Square_int s = pop_lsb(&pcs);
+        const Piece pc = piece_on(s);
+        update(color_of(pc), attacks_bb(type_of(pc), s, pieces()));
+    }
 }
 
 void Position::print_squares_attackers_count()
 {
     std::ostringstream ss;
     for (int c = 0; c < COLOR_NB; ++c) {
-        ss << "squares_attackers_count[" << c << "] :" << std::endl;
-        for (int r = RANK_8; r >= RANK_1; --r) {
-            for (int f = FILE_A; f <= FILE_H; ++f) {
-                ss << static_cast<unsigned int> (squares_attackers_count[c][f][r]) << "\t";
+        ss << "attack counts[" << c << "] :" << std::endl;
+        for (Rank r = RANK_8; r >= RANK_1; --r) {
+            for (File f = FILE_A; f <= FILE_H; ++f) {
+                ss << get_square_attackers_count(Color(c), make_square(f, r)) << "\t";
             }
             LOG::log(ss.str());
             ss.str("");
@@ -423,15 +1044,82 @@ void Position::print_squares_attackers_count()
     }
 }
 
-void Position::update_attacked_king_squares()
+/// Position::update_sliders_attackers_count() updates the attack counts of the
+/// given sliders, which did not move, after the occupancy has changed. Only the
+/// squares they gained or lost are touched.
+
+void Position::update_sliders_attackers_count(Bitboard sliders, Bitboard oldOccupied)
 {
-    for (int f = 0; f < 8; ++f)
-        for (int r = 0; r < 8; ++r) {
-            const Piece pc = board[f][r];
-            const PieceType pt = type_of(pc);
-            if (pt == BISHOP || pt == ROOK || pt == QUEEN) {
-                if (color_of(pc) != sideToMove)
-                    figure_attacks_behind_king_from(pt, *this, f, r, &attacked_king_squares);
-            }
-        }
+    while (sliders) {
+        const Square_int s = pop_lsb(&sliders);
+        const Piece pc = piece_on(s);
+        const Bitboard before = attacks_bb(type_of(pc), s, oldOccupied);
+        const Bitboard after  = attacks_bb(type_of(pc), s, pieces());
+        
+        inc_squares_attackers_count(color_of(pc), after & ~before);
+        dec_squares_attackers_count(color_of(pc), before & ~after);
+    }
+}
+
+
+/// Position::squares_behind_king() returns the squares behind the king of the
+/// side to move on the lines of the given checkers. They look safe in the attack
+/// counts, because the king itself blocks the checking ray.
+
+Bitboard Position::squares_behind_king(Bitboard checkers) const
+{
+    Bitboard b = 0;
+    Bitboard sliders = checkers & ~pieces(KNIGHT, PAWN);
+    
+    while (sliders) {
+        const Square_int s = pop_lsb(&sliders);
+        b |= figure_attacks_behind_king_from(type_of(piece_on(s)), *this, s);
+    }
+    
+    return b;
+}
+
+
+/// Position::pos_is_ok() performs some consistency checks for the position
+/// object and raises an assert if something wrong is detected. It recomputes
+/// the hash key, the checkers and the attack counts from scratch, so it is
+/// meant for debugging.
+
+bool Position::pos_is_ok() const
+{
+    if (   (sideToMove != WHITE && sideToMove != BLACK)
+        || piece_on(square<KING>(WHITE)) != W_KING
+        || piece_on(square<KING>(BLACK)) != B_KING
+        || (   ep_square() != SQ_NONE
+            && relative_rank(sideToMove, rank_of(ep_square())) != RANK_6))
+        assert(0 && "pos_is_ok: Default");
+    
+    if (attackers_to(square<KING>(~sideToMove)) & pieces(sideToMove))
+        assert(0 && "pos_is_ok: Kings");
+    
+    StateInfo si = *st;
+    set_state(&si);
+    
+    if (   si.key != st->key
+        || si.checkersBB != st->checkersBB
+        || si.attackedKingSquares != st->attackedKingSquares)
+        assert(0 && "pos_is_ok: State");
+    
+    uint8_t counts[COLOR_NB][SQUARE_NB] = {};
+    
+    for (Bitboard pcs = pieces(); pcs; ) {
+        const Square_int s = pop_lsb(&pcs);
+        const Piece pc = piece_on(s);
+        Bitboard b = type_of(pc) == PAWN ? pawn_attacks_from(color_of(pc), s)
+                                         : attacks_bb(type_of(pc), s, pieces());
+        while (b)
+            ++counts[color_of(pc)][pop_lsb(&b)];
+    }
+    
+    for (Color c : { WHITE, BLACK })
+        for (Square_int s = SQ_A1; s <= SQ_H8; ++s)
+            if (counts[c][s] != get_square_attackers_count(c, s))
+                assert(0 && "pos_is_ok: Attack counts");
+    
+    return true;
 }
@@ -5,6 +5,7 @@
 #include <deque>
 #include <memory> // For std::unique_ptr
 #include <string>
+#include <type_traits> // For std::is_trivially_copyable
 
 #include "bitboard.h"
 #include "types.h"
@@ -23,15 +24,18 @@ struct StateInfo {
     Square_int epSquare;
     
     // Not copied when making a move (will be recomputed anyhow)
-    Key        key;  // TODO
-    VectorSquareList checkers;
+    Key        key;
+    Bitboard   checkersBB;
+    Bitboard   attackedKingSquares; // Squares behind the king on the lines of slider checkers
     Piece      capturedPiece;
     StateInfo* previous;
-    VectorSquareList blockersForKing[COLOR_NB];
-    //VectorSquareList pinners[COLOR_NB];
-    VectorSquareList checkSquares[PIECE_TYPE_NB];
+    Bitboard   blockersForKing[COLOR_NB];
+    Bitboard   pinners[COLOR_NB];
+    Bitboard   checkSquares[PIECE_TYPE_NB];
 };
 
+static_assert(std::is_trivially_copyable<StateInfo>::value, "StateInfo is copied with memcpy()");
+
 /// A list to keep track of the position states along the setup moves (from the
 /// start position to the position just before the search starts). Needed by
 /// 'draw by repetition' detection. Use a std::deque because pointers to
@@ -39,6 +43,10 @@ struct StateInfo {
 typedef std::unique_ptr<std::deque<StateInfo>> StateListPtr;
 
 
+/// A square can be attacked at most once by each piece of a color
+constexpr int MAX_ATTACKERS = 16;
+
+
 class Position {
 public:
     Position() = default;
@@ -47,17 +55,19 @@ public:
     
     // FEN string input/output
     Position& set(const std::string& fenStr, StateInfo* si);
+    const std::string fen() const;
     void print_position() const;
     
     // Position representation
     Bitboard pieces() const;
     Bitboard pieces(PieceType pt) const;
+    Bitboard pieces(PieceType pt1, PieceType pt2) const;
     Bitboard pieces(Color c) const;
     Bitboard pieces(Color c, PieceType pt) const;
-    Piece piece_on(Square s) const;
-    Piece piece_on(int file, int rank) const;  // new 2018-12-01
     Piece piece_on(Square_int s) const;
     Square_int ep_square() const;
+    template<PieceType Pt> int count(Color c) const;
+    template<PieceType Pt> const Square_int* squares(Color c) const;
     template<PieceType Pt> Square_int square(Color c) const;
     
     // Castling
@@ -67,87 +77,95 @@ public:
     Square_int castling_rook_square(CastlingRight cr) const;
     
     // Checking
-    VectorSquareList checkers() const;
-    VectorSquareList blockers_for_king(Color c) const;
-    VectorSquareList check_squares(PieceType pt) const;
+    Bitboard checkers() const;
+    Bitboard blockers_for_king(Color c) const;
+    Bitboard pinners(Color c) const;
+    Bitboard check_squares(PieceType pt) const;
     bool in_check() const;  // new 2019-01-07
     
     // Attacks to/from a given square
-    VectorSquareList slider_blockers(Square from, Square to) const;
+    Bitboard attackers_to(Square_int s) const;
+    Bitboard attackers_to(Square_int s, Bitboard occupied) const;
+    Bitboard slider_blockers(Bitboard sliders, Square_int s, Bitboard& pinners) const;
     
     // Properties of moves
     bool legal(Move m) const;
+    bool pseudo_legal(Move m) const;
     bool gives_check(Move m) const;
+    bool see_ge(Move m, Value threshold = VALUE_ZERO) const;
     Piece captured_piece() const;
     
     // Doing moves
     void do_move(Move m, StateInfo& newSt);
     void do_move(Move m, StateInfo& newSt, bool givesCheck);
+    void undo_move(Move m);
+    void do_null_move(StateInfo& newSt);
+    void undo_null_move();
     
     // Other properties of the position
     Color side_to_move() const;
     int game_ply() const;
     int rule50_count() const;
+    bool is_draw(int ply) const;
+    Key key() const;
+    bool pos_is_ok() const;
     
-    unsigned char get_square_attackers_count(Color color, int file, int rank) const;
-    bool is_king_square_attacked(int file, int rank) const;
-    void update();
+    int get_square_attackers_count(Color color, Square_int s) const;
+    Bitboard attacked_by(Color color, int times = 1) const;
+    Bitboard attacked_king_squares() const;
+    bool is_king_square_attacked(Square_int s) const;
   
 private:
     // Initialization helpers (used while setting up a position)
     void set_castling_right(Color c, Square_int rfrom);
     void set_check_info(StateInfo* si) const;
+    void set_check_squares(StateInfo* si) const;
     void set_state(StateInfo* si) const;
     
-    void inc_square_attackers_count(Color color, int file, int rank);
-    void update_squares_attackers_count();
+    void inc_squares_attackers_count(Color color, Bitboard b);
+    void dec_squares_attackers_count(Color color, Bitboard b);
+    template<bool Add> void update_squares_attackers_count(Bitboard pcs);
+    void update_sliders_attackers_count(Bitboard sliders, Bitboard oldOccupied);
+    Bitboard move_squares(Color us, Move m) const;
+    Bitboard sliders_through(Bitboard squares) const;
     void print_squares_attackers_count();  // for debugging
-    void update_attacked_king_squares();
+    Bitboard squares_behind_king(Bitboard checkers) const;
     
     // Other helpers
-    void put_piece(Piece pc, Square s);
-    void put_piece(Piece pc, int file, int rank);
+    void put_piece(Piece pc, Square_int s);
     void remove_piece(Piece pc, Square_int s);
-    void move_piece(/*Piece pc,*/ Square from, Square to);
+    void move_piece(/*Piece pc,*/ Square_int from, Square_int to);
     template<bool Do>
-    void do_castling(Color us, Square from, Square& to/*, Square& rfrom, Square& rto*/);
+    void do_castling(Color us, Square_int from, Square_int& to, Square_int& rfrom, Square_int& rto);
     
-    // Data members
-    Piece board [8][8] = { { NO_PIECE } };
+    // Data members. The bitboards, the state pointer and the mailbox are read
+    // by every move, so they come first and fill the first three cache lines.
     Bitboard byTypeBB[PIECE_TYPE_NB];
     Bitboard byColorBB[COLOR_NB];
-    int pieceCount[PIECE_NB];
+    StateInfo* st;
+    int gamePly;
+    Color sideToMove;
+    uint8_t pieceCount[PIECE_NB];
+    Piece board[SQUARE_NB] = {};
+    uint8_t index[SQUARE_NB];
     Square_int pieceList[PIECE_NB][16];
-    int index[SQUARE_NB];
-    int castlingRightsMask[SQUARE_NB];
+    uint8_t castlingRightsMask[SQUARE_NB];
     Square_int castlingRookSquare[CASTLING_RIGHT_NB];
     Bitboard castlingPath[CASTLING_RIGHT_NB];
-    int gamePly;
-    Color sideToMove;
-    StateInfo* st;
-    unsigned char squares_attackers_count [COLOR_NB][8][8] = { { { 0 } } };  // calculated after UCI "go" command
-    VectorSquareList attacked_king_squares;  // Attacked squares behind king (by bishop, rook or queen)
+    Bitboard attackedBy[COLOR_NB][MAX_ATTACKERS];  // updated by do_move() and undo_move()
 };
 
+static_assert(sizeof(Position) <= 1024, "Position should stay within 16 cache lines");
+
 
 inline Color Position::side_to_move() const
 {
     return sideToMove;
 }
 
-inline Piece Position::piece_on(Square s) const
-{
-    return board[s.file][s.rank];
-}
-
-inline Piece Position::piece_on(int file, int rank) const
-{
-    return board[file][rank];
-}
-
 inline Piece Position::piece_on(Square_int s) const
 {
-    return board [file_of(s)] [rank_of(s)];
+    return board[s];
 }
 
 inline Bitboard Position::pieces() const
@@ -160,6 +178,11 @@ inline Bitboard Position::pieces(PieceType pt) const
     return byTypeBB[pt];
 }
 
+inline Bitboard Position::pieces(PieceType pt1, PieceType pt2) const
+{
+    return byTypeBB[pt1] | byTypeBB[pt2];
+}
+
 inline Bitboard Position::pieces(Color c) const
 {
     return byColorBB[c];
@@ -175,6 +198,16 @@ inline Square_int Position::ep_square() const
     return st->epSquare;
 }
 
+template<PieceType Pt> inline int Position::count(Color c) const
+{
+    return pieceCount[make_piece(c, Pt)];
+}
+
+template<PieceType Pt> inline const Square_int* Position::squares(Color c) const
+{
+    return pieceList[make_piece(c, Pt)];
+}
+
 template<PieceType Pt> inline Square_int Position::square(Color c) const
 {
     assert(pieceCount[make_piece(c, Pt)] == 1);
@@ -201,39 +234,91 @@ inline Square_int Position::castling_rook_square(CastlingRight cr) const
     return castlingRookSquare[cr];
 }
 
-inline void Position::inc_square_attackers_count(Color color, int file, int rank)
+/// The attack counts are stored as thermometer coded bitboard layers:
+/// attackedBy[c][n] holds the squares attacked at least n + 1 times by color c.
+/// Adding a set of attacks works like a carry chain, a square attacked n times
+/// gains layer n and the carry goes on only while some square is already on
+/// the next layer. Removing clears the top layer of each square in the same way.
+
+inline void Position::inc_squares_attackers_count(Color color, Bitboard b)
+{
+    for (Bitboard* layer = attackedBy[color]; b; ++layer) {
+        assert(layer < attackedBy[color] + MAX_ATTACKERS);
+        const Bitboard carry = *layer & b;
+        *layer |= b;
+        b = carry;
+    }
+}
+
+inline void Position::dec_squares_attackers_count(Color color, Bitboard b)
+{
+    for (Bitboard* layer = attackedBy[color]; b; ++layer) {
+        const Bitboard next = layer + 1 < attackedBy[color] + MAX_ATTACKERS ? layer[1] : 0;
+        *layer &= ~(b & ~next);
+        b &= next;
+    }
+}
+
+inline int Position::get_square_attackers_count(Color color, Square_int s) const
+{
+    int n = 0;
+    while (n < MAX_ATTACKERS && (attackedBy[color][n] & s))
+        ++n;
+    return n;
+}
+
+/// Position::attacked_by() returns the squares attacked at least the given
+/// number of times by the given color, e.g. attacked_by(us, 2) & ~attacked_by(them)
+/// are the squares we attack twice and the opponent does not defend.
+
+inline Bitboard Position::attacked_by(Color color, int times) const
 {
-    ++squares_attackers_count[color][file][rank];
+    assert(times >= 1 && times <= MAX_ATTACKERS);
+    return attackedBy[color][times - 1];
 }
 
-inline unsigned char Position::get_square_attackers_count(Color color, int file, int rank) const
+inline Bitboard Position::attacked_king_squares() const
 {
-    return squares_attackers_count[color][file][rank];
+    return st->attackedKingSquares;
 }
 
-inline bool Position::is_king_square_attacked(int file, int rank) const
+inline bool Position::is_king_square_attacked(Square_int s) const
 {
-    return attacked_king_squares.contains(Square(file, rank));
+    return st->attackedKingSquares & s;
 }
 
-inline VectorSquareList Position::checkers() const {
-    return st->checkers;
+inline Bitboard Position::checkers() const {
+    return st->checkersBB;
 }
 
-inline VectorSquareList Position::blockers_for_king(Color c) const
+inline Bitboard Position::blockers_for_king(Color c) const
 {
     return st->blockersForKing[c];
 }
 
-inline VectorSquareList Position::check_squares(PieceType pt) const
+inline Bitboard Position::pinners(Color c) const
+{
+    return st->pinners[c];
+}
+
+inline Bitboard Position::check_squares(PieceType pt) const
 {
     return st->checkSquares[pt];
 }
 
 inline bool Position::in_check() const
 {
-    const Square_int king_sq = square<KING>(sideToMove);
-    return squares_attackers_count [~sideToMove] [file_of(king_sq)] [rank_of(king_sq)];
+    return st->checkersBB;
+}
+
+inline Bitboard Position::attackers_to(Square_int s) const
+{
+    return attackers_to(s, pieces());
+}
+
+inline Key Position::key() const
+{
+    return st->key;
 }
 
 inline int Position::game_ply() const
@@ -251,15 +336,9 @@ inline Piece Position::captured_piece() const
     return st->capturedPiece;
 }
 
-inline void Position::put_piece(Piece pc, Square s)
-{
-    put_piece(pc, s.file, s.rank);
-}
-
-inline void Position::put_piece(Piece pc, int file, int rank)
+inline void Position::put_piece(Piece pc, Square_int s)
 {
-    board[file][rank] = pc;
-    const Square_int s = make_square(static_cast<File>(file), static_cast<Rank>(rank));
+    board[s] = pc;
     byTypeBB[ALL_PIECES] |= s;
     byTypeBB[type_of(pc)] |= s;
     byColorBB[color_of(pc)] |= s;
@@ -274,18 +353,18 @@ inline void Position::remove_piece(Piece pc, Square_int s)
     byTypeBB[type_of(pc)] ^= s;
     byColorBB[color_of(pc)] ^= s;
     
-    Square lastSquare = pieceList[pc][--pieceCount[pc]];
+    Square_int lastSquare = pieceList[pc][--pieceCount[pc]];
     index[lastSquare] = index[s];
     pieceList[pc][index[lastSquare]] = lastSquare;
     pieceList[pc][pieceCount[pc]] = SQ_NONE;
     //pieceCount[make_piece(color_of(pc), ALL_PIECES)]--;
 }
 
-inline void Position::move_piece(/*Piece pc,*/ Square from, Square to)
+inline void Position::move_piece(/*Piece pc,*/ Square_int from, Square_int to)
 {
-    const Piece pc = board[from.file][from.rank];
-    board[to.file][to.rank] = pc;
-    board[from.file][from.rank] = NO_PIECE;
+    const Piece pc = board[from];
+    board[to] = pc;
+    board[from] = NO_PIECE;
     
     // index[from] is not updated and becomes stale. This works as long as index[]
     // is accessed just by known occupied squares.
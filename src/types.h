@@ -1,11 +1,23 @@
 #ifndef TYPES_H_INCLUDED
 #define TYPES_H_INCLUDED
 
-#include <algorithm>  // For std::find
+#include <algorithm>  // For std::max
 #include <cassert>
 #include <cstddef> // For size_t
 #include <cstdint> // For uint64_t
-#include <vector>
+
+#if defined(USE_PEXT)
+#  include <immintrin.h> // Header for _pext_u64() intrinsic
+#  define pext(b, m) _pext_u64(b, m)
+#else
+#  define pext(b, m) 0
+#endif
+
+#ifdef USE_PEXT
+constexpr bool HasPext = true;
+#else
+constexpr bool HasPext = false;
+#endif
 
 typedef uint64_t Key;
 typedef uint64_t Bitboard;
@@ -31,20 +43,35 @@ enum CastlingRight {
     CASTLING_RIGHT_NB = 16
 };
 
+enum Value : int {
+    VALUE_ZERO = 0,
+    
+    PawnValue   = 171,
+    KnightValue = 764,
+    BishopValue = 826,
+    RookValue   = 1282,
+    QueenValue  = 2526
+};
+
 enum PieceType {
     NO_PIECE_TYPE, PAWN, KNIGHT, BISHOP, ROOK, QUEEN, KING,
     ALL_PIECES = 0,
     PIECE_TYPE_NB = 8
 };
 
-enum Piece {
+enum Piece : uint8_t {
     NO_PIECE,
     W_PAWN = 1, W_KNIGHT, W_BISHOP, W_ROOK, W_QUEEN, W_KING,
     B_PAWN = 9, B_KNIGHT, B_BISHOP, B_ROOK, B_QUEEN, B_KING,
     PIECE_NB = 16
 };
 
-enum Square_int : int {
+constexpr Value PieceValue[PIECE_NB] = {
+    VALUE_ZERO, PawnValue, KnightValue, BishopValue, RookValue, QueenValue, VALUE_ZERO, VALUE_ZERO,
+    VALUE_ZERO, PawnValue, KnightValue, BishopValue, RookValue, QueenValue, VALUE_ZERO, VALUE_ZERO
+};
+
+enum Square_int : uint8_t {
     SQ_A1, SQ_B1, SQ_C1, SQ_D1, SQ_E1, SQ_F1, SQ_G1, SQ_H1,
     SQ_A2, SQ_B2, SQ_C2, SQ_D2, SQ_E2, SQ_F2, SQ_G2, SQ_H2,
     SQ_A3, SQ_B3, SQ_C3, SQ_D3, SQ_E3, SQ_F3, SQ_G3, SQ_H3,
@@ -78,90 +105,53 @@ enum Rank : int {
     RANK_1, RANK_2, RANK_3, RANK_4, RANK_5, RANK_6, RANK_7, RANK_8, RANK_NB
 };
 
-struct Square {
-    Square() { file = FILE_A; rank = RANK_1; }
-    Square(File f, Rank r) { file = f; rank = r; }
-    Square(int f, int r) { file = static_cast<File>(f); rank = static_cast<Rank>(r); }
-    Square(Square_int sqi) { file = File(sqi & 7); rank = Rank(sqi >> 3); }
-    operator Square_int() const { return Square_int((rank << 3) + file); }    // same as make_square()
-    File file;
-    Rank rank;
+/// A move needs 16 bits to be stored
+///
+/// bit  0- 5: destination square (from 0 to 63)
+/// bit  6-11: origin square (from 0 to 63)
+/// bit 12-13: promotion piece type - 2 (from KNIGHT-2 to QUEEN-2)
+/// bit 14-15: special move flag: promotion (1), en passant (2), castling (3)
+///
+/// Special cases are MOVE_NONE and MOVE_NULL. We can sneak these in because in
+/// any normal move destination square is always different from origin square
+/// while MOVE_NONE and MOVE_NULL have the same origin and destination square.
+
+enum Move : uint16_t {
+    MOVE_NONE,
+    MOVE_NULL = 65
 };
 
 enum MoveType {
     NORMAL,
-    PROMOTION = 1 << 2,
-    ENPASSANT = 2 << 2,
-    CASTLING  = 3 << 2,
-    
-    MOVE_NONE = 1 << 4,
-    MOVE_NULL = 1 << 5
+    PROMOTION = 1 << 14,
+    ENPASSANT = 2 << 14,
+    CASTLING  = 3 << 14
 };
 
-struct Move {
-    Move() = default;
-    Move(Square f, Square t)  { from = f; to = t; flags = 0; }
-    Move(Square f, Square t, MoveType flags_)  { from = f; to = t; flags = flags_; }
-    Move(Square f, Square t, PieceType prom)  { from = f; to = t; flags = PROMOTION + prom - KNIGHT; }
-    Square from;
-    Square to;
-    /// bit 0-1: promotion piece type - 2 (from KNIGHT-2 to QUEEN-2)
-    /// bit 2-3: special move flag: promotion (1), en passant (2), castling (3)
-    /// bit 4: MOVE_NONE
-    /// bit 5: MOVE_NULL
-    unsigned char flags;
-};
-
-struct SquareList {
-    void addSquare(Square sq) { *last++ = sq; }
-    void push(SquareList& other)
-    {
-        for (const auto& sq : other)
-            *last++ = sq;
-    }
-    const Square* begin() const { return squareList; }
-    const Square* end() const { return last; }
-    size_t size() const { return last - squareList; }
-private:
-    Square squareList[SQUARE_NB], *last = &squareList[0];
-};
-
-struct VectorSquareList {
-    VectorSquareList() = default;
-    VectorSquareList(Square sq) { squareList.push_back(sq); }
-    void addSquare(Square sq)
-    {
-        if (std::find(squareList.cbegin(), squareList.cend(), sq) == squareList.cend())  // Push only unique values
-            squareList.push_back(sq);
-    }
-    bool contains(Square sq) const
-    {
-        return std::find(squareList.cbegin(), squareList.cend(), sq) != squareList.cend();
-    }
-    Square front() const { return squareList.front(); }
-    size_t size() const { return squareList.size(); }
-    void clear() { squareList.clear(); }
-private:
-    std::vector<Square> squareList;
-};
-
-
 #define ENABLE_INCR_OPERATORS_ON(T)                                \
-inline T& operator++(T& d) { return d = T(int(d) + 1); }           \
-inline T& operator--(T& d) { return d = T(int(d) - 1); }
+constexpr T& operator++(T& d) { return d = T(int(d) + 1); }        \
+constexpr T& operator--(T& d) { return d = T(int(d) - 1); }
 
+ENABLE_INCR_OPERATORS_ON(Color)
 ENABLE_INCR_OPERATORS_ON(Square_int)
 ENABLE_INCR_OPERATORS_ON(File)
 ENABLE_INCR_OPERATORS_ON(Rank)
 
 #undef ENABLE_INCR_OPERATORS_ON
 
+constexpr Value operator+(Value v1, Value v2) { return Value(int(v1) + int(v2)); }
+constexpr Value operator-(Value v1, Value v2) { return Value(int(v1) - int(v2)); }
+constexpr Value operator-(Value v) { return Value(-int(v)); }
+constexpr Value& operator+=(Value& v1, Value v2) { return v1 = v1 + v2; }
+constexpr Value& operator-=(Value& v1, Value v2) { return v1 = v1 - v2; }
+constexpr Value operator-(Value v, int i) { return Value(int(v) - i); }
+
 
 /// Additional operators to add a Direction to a Square_int
 constexpr Square_int operator+(Square_int s, Direction d) { return Square_int(int(s) + int(d)); }
 constexpr Square_int operator-(Square_int s, Direction d) { return Square_int(int(s) - int(d)); }
-inline Square_int& operator+=(Square_int& s, Direction d) { return s = s + d; }
-inline Square_int& operator-=(Square_int& s, Direction d) { return s = s - d; }
+constexpr Square_int& operator+=(Square_int& s, Direction d) { return s = s + d; }
+constexpr Square_int& operator-=(Square_int& s, Direction d) { return s = s - d; }
 
 constexpr Color operator~(Color c) {
     return Color(c ^ BLACK);  // Toggle color
@@ -177,6 +167,10 @@ constexpr CastlingRight make_castling() {
                         : S == QUEEN_SIDE ? BLACK_OOO : BLACK_OO;
 }
 
+constexpr bool is_ok(Square_int s) {
+    return s >= SQ_A1 && s <= SQ_H8;
+}
+
 constexpr Square_int make_square(File f, Rank r) {
     return Square_int((r << 3) + f);
 }
@@ -214,12 +208,40 @@ constexpr Direction pawn_push(Color c) {
     return c == WHITE ? NORTH : SOUTH;
 }
 
-constexpr MoveType type_of(/*Move m*/ unsigned char move_flags) {
-    return MoveType(move_flags & (15 << 2));
+constexpr Square_int from_sq(Move m) {
+    return Square_int((m >> 6) & 0x3F);
+}
+
+constexpr Square_int to_sq(Move m) {
+    return Square_int(m & 0x3F);
+}
+
+constexpr int from_to(Move m) {
+    return m & 0xFFF;
+}
+
+constexpr MoveType type_of(Move m) {
+    return MoveType(m & (3 << 14));
 }
 
-constexpr PieceType promotion_type(/*Move m*/ unsigned char move_flags) {
-    return PieceType((move_flags & 3) + KNIGHT);
+constexpr PieceType promotion_type(Move m) {
+    return PieceType(((m >> 12) & 3) + KNIGHT);
 }
 
+constexpr Move make_move(Square_int from, Square_int to) {
+    return Move((from << 6) + to);
+}
+
+template<MoveType T>
+constexpr Move make(Square_int from, Square_int to, PieceType pt = KNIGHT) {
+    return Move(T + ((pt - KNIGHT) << 12) + (from << 6) + to);
+}
+
+constexpr bool is_ok(Move m) {
+    return from_sq(m) != to_sq(m); // Catch MOVE_NULL and MOVE_NONE
+}
+
+static_assert(sizeof(Square_int) == 1 && sizeof(Piece) == 1, "Squares and pieces should fit in a byte");
+static_assert(sizeof(Move) == 2, "A move should fit in 16 bits");
+
 #endif // #ifndef TYPES_H_INCLUDED
@@ -1,12 +1,16 @@
+#include <cstdlib>  // For std::atoi
 #include <iostream>
 #include <sstream>
 #include <string>
 #include <ctime>    // For std::time
+#include <thread>   // For std::thread::hardware_concurrency
 
 #include "uci.h"
+#include "benchmark.h"
 #include "log.h"
 #include "misc.h"
 #include "movegen.h"
+#include "perft.h"
 #include "position.h"
 
 using namespace std;
@@ -43,18 +47,37 @@ namespace {
         pos.set(fen, &states->back());
         
         // Parse move list (if any)
-        while (is >> token && MOVEGEN::check_move(  pos,  (m = UCI::to_move(pos, token))  )) {
+        while (is >> token && (m = UCI::to_move(pos, token)) != MOVE_NONE) {
             states->emplace_back();
             pos.do_move(m, states->back());
         }
     }
     
     
-    // go() is called when engine receives the "go" UCI command.
+    // go() is called when engine receives the "go" UCI command. "go perft <depth>
+    // [threads <n>] [split <plies>]" counts the leaf nodes under each root move
+    // instead of searching, on n threads with the tree split at the given ply.
     
     void go(Position& pos, istringstream& is/*, StateListPtr& states*/)
     {
-        pos.update();
+        string token;
+        int depth = 0, threads = 1, splitDepth = Perft::DefaultSplitDepth;
+        bool perft = false;
+        
+        while (is >> token)
+            if (token == "perft")
+                perft = true, is >> depth;
+            else if (token == "threads")
+                is >> threads;
+            else if (token == "split")
+                is >> splitDepth;
+        
+        if (perft) {
+            if (depth > 0)
+                Perft::divide(pos, depth, cout, std::max(threads, 1), splitDepth);
+            return;
+        }
+        
         MoveList<LEGAL> move_list = MoveList<LEGAL>(pos);
         
         std::ostringstream moves;
@@ -71,19 +94,100 @@ namespace {
     }
     
     
-    Square get_sq(char file, char rank)
+    // bench() is called when engine receives the "bench" command, also given on
+    // the command line. "bench [depth] [threads] [hashMB]" runs the signature
+    // bench, perft to the given depth (default 5) on the benchmark positions.
+    // The other benchmarks are selected by a subcommand:
+    //
+    //   bench movegen [iterations]           throughput of each move generator type
+    //   bench see [iterations]               throughput of the static exchange evaluation
+    //   bench perft [depth] [threads] [hashMB]  reference perft counts, and the
+    //                                        gain of the perft table given a hash size
+    //   bench scaling [depth] [threads]      perft speed from one thread up to n
+    //   bench walker [depth] [walkers]       interleaved against plain perft walker
+    
+    void bench(istringstream& is)
+    {
+        string token;
+        const auto args = is.tellg();
+        
+        if (!(is >> token) || isdigit(token[0])) {
+            is.clear();
+            is.seekg(args);
+            token.clear();
+        }
+        
+        // Reads the next numeric argument, if any
+        auto next = [&](int def) {
+            int v;
+            return (is >> v) ? v : def;
+        };
+        
+        const int hardwareThreads = int(std::max(std::thread::hardware_concurrency(), 1u));
+        
+        if (token.empty()) {
+            int depth = next(5), threads = next(1), hashMB = next(16);
+            Benchmark::run(cout, std::max(depth, 1), std::max(threads, 1), size_t(std::max(hashMB, 0)));
+        }
+        else if (token == "movegen")
+            Benchmark::movegen(cout, std::max(next(200000), 1));
+        else if (token == "see")
+            Benchmark::see(cout, std::max(next(200000), 1));
+        else if (token == "perft") {
+            int depth = next(4), threads = next(1), hashMB = next(0);
+            Benchmark::perft(cout, std::min(std::max(depth, 1), Benchmark::MaxPerftDepth),
+                             std::max(threads, 1), size_t(std::max(hashMB, 0)));
+        }
+        else if (token == "scaling") {
+            int depth = next(4), threads = next(hardwareThreads);
+            Benchmark::scaling(cout, std::min(std::max(depth, 1), Benchmark::MaxPerftDepth), std::max(threads, 1));
+        }
+        else if (token == "walker") {
+            int depth = next(4), walkers = next(Perft::DefaultWalkers);
+            Benchmark::walker(cout, std::min(std::max(depth, 1), Benchmark::MaxPerftDepth), std::max(walkers, 1));
+        }
+        else
+            cout << "Unknown bench type: " << token << endl;
+    }
+    
+    
+    // setoption() is called when engine receives the "setoption" UCI command.
+    // The only option is "Hash", the size in MB of the perft table.
+    
+    void setoption(istringstream& is)
+    {
+        string token, name, value;
+        
+        is >> token; // Consume "name" token
+        
+        // Read option name (can contain spaces)
+        while (is >> token && token != "value")
+            name += (name.empty() ? "" : " ") + token;
+        
+        // Read option value (can contain spaces)
+        while (is >> token)
+            value += (value.empty() ? "" : " ") + token;
+        
+        if (name == "Hash")
+            Perft::TT.resize(size_t(std::max(std::atoi(value.c_str()), 0)));
+        else
+            cout << "No such option: " << name << endl;
+    }
+    
+    
+    Square_int get_sq(char file, char rank)
     {
         unsigned char f = file - 'a';
         unsigned char r = rank - '1';
-        return Square(f, r);
+        return make_square(File(f), Rank(r));
     }
     
-    Square from_sq(string& move)
+    Square_int from_sq(string& move)
     {
         return get_sq(move[0], move[1]);
     }
     
-    Square to_sq(string& move)
+    Square_int to_sq(string& move)
     {
         return get_sq(move[2], move[3]);
     }
@@ -92,9 +196,10 @@ namespace {
 
 
 /// UCI::loop() waits for a command from stdin, parses it and calls the appropriate
-/// function.
+/// function. A command given on the command line, like "bench", is run once and
+/// the engine exits.
 
-void UCI::loop()
+void UCI::loop(int argc, char* argv[])
 {
         Position pos;
         string token, cmd;
@@ -105,8 +210,11 @@ void UCI::loop()
         // Use current time as seed for random generator
         std::srand(std::time(0));  // For go()
         
+        for (int i = 1; i < argc; ++i)
+            cmd += std::string(argv[i]) + " ";
+        
         do {
-            if (!getline(std::cin, cmd)) // Block here waiting for input or EOF
+            if (argc == 1 && !getline(std::cin, cmd)) // Block here waiting for input or EOF
                 cmd = "quit";
             
             std::istringstream is(cmd);
@@ -121,21 +229,24 @@ void UCI::loop()
                 ;
             else if (token == "uci")
                 std::cout << "id name " << engine_info(true)
+                          << "\noption name Hash type spin default 0 min 0 max 65536"
                           << "\nuciok"  << std::endl;
             else if (token == "isready")    std::cout << "readyok" << std::endl;
+            else if (token == "setoption")  setoption(is);
             else if (token == "position")   position(pos, is, states);
             else if (token == "go")         go(pos, is/*, states*/);
+            else if (token == "bench")      bench(is);
             else
                 std::cout << "Unknown command: " << cmd << std::endl;
-        } while (token != "quit");
+        } while (token != "quit" && argc == 1); // Command line args are one-shot
 }
 
 
-/// UCI::square() converts a Square to a string in algebraic notation (g1, a7, etc.)
+/// UCI::square() converts a Square_int to a string in algebraic notation (g1, a7, etc.)
 
-std::string UCI::square(Square s)
+std::string UCI::square(Square_int s)
 {
-    return std::string{ char('a' + s.file), char('1' + s.rank) };
+    return std::string{ char('a' + file_of(s)), char('1' + rank_of(s)) };
 }
 
 
@@ -143,37 +254,66 @@ std::string UCI::square(Square s)
 
 string UCI::move(Move m/*, bool chess960*/)
 {
-    Square to = m.to;
+    Square_int from = from_sq(m);
+    Square_int to = to_sq(m);
     
-    if (type_of(m.flags) == MOVE_NONE)
+    if (m == MOVE_NONE)
         return "(none)";
     
-    if (type_of(m.flags) == MOVE_NULL)
+    if (m == MOVE_NULL)
         return "0000";
     
-    if (type_of(m.flags) == CASTLING /*&& !chess960*/)
-        to = make_square(to > m.from ? FILE_G : FILE_C, rank_of(m.from));
+    if (type_of(m) == CASTLING /*&& !chess960*/)
+        to = make_square(to > from ? FILE_G : FILE_C, rank_of(from));
     
-    string move = UCI::square(m.from) + UCI::square(to);
+    string move = UCI::square(from) + UCI::square(to);
     
-    if (type_of(m.flags) == PROMOTION)
-        move += " pnbrqk"[promotion_type(m.flags)];
+    if (type_of(m) == PROMOTION)
+        move += " pnbrqk"[promotion_type(m)];
     
     return move;
 }
 
 
 /// UCI::to_move() converts a string representing a move in coordinate notation
-/// (g1f3, a7a8q) to the corresponding legal Move, if any.
+/// (g1f3, a7a8q) to the corresponding legal Move, if any. The move is built from
+/// the string and validated with pseudo_legal() and legal(), without generating
+/// the whole move list.
 
 Move UCI::to_move(const Position& pos, string& str)
 {
     if (str.length() == 5) // Junior could send promotion piece in uppercase
         str[4] = char(tolower(str[4]));
-
-    for (const auto& m : MoveList<LEGAL>(pos))
-        if (str == UCI::move(m/*, pos.is_chess960()*/))
-            return m;
-
-    return Move(SQ_NONE, SQ_NONE, MOVE_NONE);
+    
+    if (   (str.length() != 4 && str.length() != 5)
+        || str[0] < 'a' || str[0] > 'h' || str[1] < '1' || str[1] > '8'
+        || str[2] < 'a' || str[2] > 'h' || str[3] < '1' || str[3] > '8')
+        return MOVE_NONE;
+    
+    Color us = pos.side_to_move();
+    Square_int from = from_sq(str);
+    Square_int to = to_sq(str);
+    PieceType pt = type_of(pos.piece_on(from));
+    Move m;
+    
+    if (str.length() == 5) {
+        size_t promotion = string("nbrq").find(str[4]);
+        if (promotion == string::npos)
+            return MOVE_NONE;
+        
+        m = make<PROMOTION>(from, to, PieceType(KNIGHT + promotion));
+    }
+    else if (pt == KING && distance(file_of(from), file_of(to)) == 2) {
+        CastlingRight cr = us | (to > from ? KING_SIDE : QUEEN_SIDE);
+        if (!pos.can_castle(cr))
+            return MOVE_NONE;
+        
+        m = make<CASTLING>(from, pos.castling_rook_square(cr));
+    }
+    else if (pt == PAWN && to == pos.ep_square())
+        m = make<ENPASSANT>(from, to);
+    else
+        m = make_move(from, to);
+    
+    return pos.pseudo_legal(m) && pos.legal(m) ? m : MOVE_NONE;
 }
@@ -9,8 +9,8 @@ class Position;
 
 namespace UCI {
     
-    void loop();
-    std::string square(Square s);
+    void loop(int argc, char* argv[]);
+    std::string square(Square_int s);
     std::string move(Move m/*, bool chess960*/);
     Move to_move(const Position& pos, std::string& str);
     